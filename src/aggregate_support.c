@@ -0,0 +1,422 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <pthread.h>
+
+#include "alias_support.h"
+#include "dealias_support.h"
+#include "batch_support.h"
+#include "aggregate_support.h"
+#include "allocator_support.h"
+
+/* The expanded commands are read back this much at a time, in a
+   buffer which grows to hold any longer line. */
+
+#define READ_SIZE (1024 * 1024)
+
+#define NO_KEY (-1)
+
+static unsigned long long hash_key( const char *key, size_t length )
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i;
+
+    for ( i = 0; i < length; i++ ) {
+        hash ^= (unsigned char) key[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/* The hash table has at least twice as many slots as there can be
+   keys, so the probe sequences stay short. */
+
+Aggregate *new_aggregate( int max_keys )
+{
+    Aggregate *aggregate = allocate_zeroed( 1, sizeof(Aggregate) );
+    unsigned int i;
+
+    if ( max_keys < 1 ) {
+        max_keys = 1;
+    }
+
+    aggregate->max_keys = max_keys;
+    aggregate->heap = allocate( max_keys * sizeof(CountedKey) );
+
+    aggregate->n_slots = 1;
+    while ( aggregate->n_slots < 2 * (unsigned int) max_keys ) {
+        aggregate->n_slots <<= 1;
+    }
+    aggregate->slots = allocate( aggregate->n_slots * sizeof(int) );
+    for ( i = 0; i < aggregate->n_slots; i++ ) {
+        aggregate->slots[i] = NO_KEY;
+    }
+
+    return aggregate;
+}
+
+void free_aggregate( Aggregate *aggregate )
+{
+    int i;
+
+    for ( i = 0; i < aggregate->n_keys; i++ ) {
+        deallocate( aggregate->heap[i].key );
+    }
+    deallocate( aggregate->heap );
+    deallocate( aggregate->slots );
+    deallocate( aggregate );
+}
+
+/* Swap two keys in the heap, keeping the hash table pointing at
+   them. */
+
+static void swap_keys( Aggregate *aggregate, int i, int j )
+{
+    CountedKey key = aggregate->heap[i];
+
+    aggregate->heap[i] = aggregate->heap[j];
+    aggregate->heap[j] = key;
+    aggregate->slots[aggregate->heap[i].slot] = i;
+    aggregate->slots[aggregate->heap[j].slot] = j;
+}
+
+static void sift_up( Aggregate *aggregate, int i )
+{
+    while ( (i > 0) && (aggregate->heap[i].count < aggregate->heap[(i - 1) / 2].count) ) {
+        swap_keys( aggregate, i, (i - 1) / 2 );
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down( Aggregate *aggregate, int i )
+{
+    int smallest;
+    int child;
+
+    for ( ;; ) {
+        smallest = i;
+        for ( child = 2 * i + 1; (child <= 2 * i + 2) && (child < aggregate->n_keys); child++ ) {
+            if ( aggregate->heap[child].count < aggregate->heap[smallest].count ) {
+                smallest = child;
+            }
+        }
+
+        if ( smallest == i ) {
+            return;
+        }
+
+        swap_keys( aggregate, i, smallest );
+        i = smallest;
+    }
+}
+
+/* The first free slot for a key with this hash. */
+
+static unsigned int free_slot( Aggregate *aggregate, unsigned long long hash )
+{
+    unsigned int mask = aggregate->n_slots - 1;
+    unsigned int slot = hash & mask;
+
+    while ( aggregate->slots[slot] != NO_KEY ) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/* Empty a slot of the hash table, moving back any keys further along
+   the probe sequence which would no longer be found. */
+
+static void empty_slot( Aggregate *aggregate, unsigned int slot )
+{
+    unsigned int mask = aggregate->n_slots - 1;
+    unsigned int next = slot;
+    unsigned int home;
+
+    aggregate->slots[slot] = NO_KEY;
+
+    for ( ;; ) {
+        next = (next + 1) & mask;
+        if ( aggregate->slots[next] == NO_KEY ) {
+            return;
+        }
+
+        /* A key can move back to the empty slot unless its own slot
+           lies cyclically after the empty slot, up to where it is. */
+
+        home = aggregate->heap[aggregate->slots[next]].hash & mask;
+        if ( ((next - home) & mask) >= ((next - slot) & mask) ) {
+            aggregate->slots[slot] = aggregate->slots[next];
+            aggregate->heap[aggregate->slots[slot]].slot = slot;
+            aggregate->slots[next] = NO_KEY;
+            slot = next;
+        }
+    }
+}
+
+/* Count one more occurrence of a key. */
+
+void count_key( Aggregate *aggregate, const char *key, size_t length )
+{
+    unsigned long long hash = hash_key( key, length );
+    unsigned int mask = aggregate->n_slots - 1;
+    unsigned int slot;
+    CountedKey *counted;
+    int i;
+
+    aggregate->total++;
+
+    for ( slot = hash & mask; aggregate->slots[slot] != NO_KEY; slot = (slot + 1) & mask ) {
+        i = aggregate->slots[slot];
+        counted = &(aggregate->heap[i]);
+        if ( (counted->hash == hash) && (counted->length == length) &&
+             (memcmp( counted->key, key, length ) == 0) ) {
+            counted->count++;
+            sift_down( aggregate, i );
+            return;
+        }
+    }
+
+    if ( aggregate->n_keys < aggregate->max_keys ) {
+        i = aggregate->n_keys++;
+        counted = &(aggregate->heap[i]);
+        counted->count = 1;
+        counted->error = 0;
+    } else {
+
+        /* The table is full, so the new key takes over from the key
+           with the lowest count. */
+
+        i = 0;
+        counted = &(aggregate->heap[0]);
+        empty_slot( aggregate, counted->slot );
+        slot = free_slot( aggregate, hash );
+        deallocate( counted->key );
+        counted->error = counted->count;
+        counted->count++;
+        aggregate->replaced++;
+    }
+
+    counted->key = copy_substring( key, length );
+    counted->length = length;
+    counted->hash = hash;
+    counted->slot = slot;
+    aggregate->slots[slot] = i;
+
+    if ( i > 0 ) {
+        sift_up( aggregate, i );
+    } else {
+        sift_down( aggregate, i );
+    }
+}
+
+static int compare_counts( const void *a, const void *b )
+{
+    const CountedKey *x = *(const CountedKey **) a;
+    const CountedKey *y = *(const CountedKey **) b;
+
+    if ( x->count != y->count ) {
+        return (x->count > y->count) ? -1 : 1;
+    }
+
+    return strcmp( x->key, y->key );
+}
+
+/* Print the n keys with the highest counts, highest first. Once keys
+   have been replaced, the counts are only upper bounds, so each one
+   is followed by how much it may be over. */
+
+void print_top_keys( Aggregate *aggregate, FILE *f, int n )
+{
+    CountedKey **sorted;
+    int i;
+
+    sorted = allocate( (aggregate->n_keys + 1) * sizeof(CountedKey *) );
+    for ( i = 0; i < aggregate->n_keys; i++ ) {
+        sorted[i] = &(aggregate->heap[i]);
+    }
+    qsort( sorted, aggregate->n_keys, sizeof(CountedKey *), compare_counts );
+
+    if ( aggregate->replaced == 0 ) {
+        fprintf( f, "# %lu counted, %d distinct\n", aggregate->total, aggregate->n_keys );
+    } else {
+        fprintf( f, "# %lu counted, more than %d distinct: counts are upper bounds,"
+                 " less at most the second column\n", aggregate->total, aggregate->max_keys );
+    }
+
+    for ( i = 0; (i < n) && (i < aggregate->n_keys); i++ ) {
+        if ( aggregate->replaced == 0 ) {
+            fprintf( f, "%10lu  ", sorted[i]->count );
+        } else {
+            fprintf( f, "%10lu %10lu  ", sorted[i]->count, sorted[i]->error );
+        }
+        fwrite( sorted[i]->key, 1, sorted[i]->length, f );
+        fputc( '\n', f );
+    }
+
+    deallocate( sorted );
+}
+
+/* Count the names of the simple commands in an expanded command. */
+
+static void count_names( Aggregate *aggregate, const char *command, size_t length )
+{
+    CommandList *commands;
+    Span *span;
+    char *text;
+    size_t n;
+
+    commands = split_into_simple_commands( copy_substring( command, length ) );
+
+    for ( span = commands->spans; span < commands->spans + commands->n_spans; span++ ) {
+        if ( !span->is_separator ) {
+            text = &(commands->text[span->start]);
+            n = 0;
+            while ( (n < span->length) && !isspace( text[n] ) ) {
+                n++;
+            }
+            if ( n > 0 ) {
+                count_key( aggregate, text, n );
+            }
+        }
+    }
+
+    free_command_list( commands );
+}
+
+/* Count an expanded command. An empty line, which is how batch mode
+   writes out a command which couldn't be expanded, isn't counted. */
+
+static void count_line( Aggregate *aggregate, int by_name, const char *line, size_t length )
+{
+    if ( length == 0 ) {
+        return;
+    }
+
+    if ( by_name ) {
+        count_names( aggregate, line, length );
+    } else {
+        count_key( aggregate, line, length );
+    }
+}
+
+/* The commands are expanded by the batch mode pipeline, which writes
+   them down a pipe to be counted. */
+
+typedef struct expansion_thread {
+    pthread_t thread;
+    int in_fd;
+    int out_fd;
+    AliasTable *aliases;
+    int n_expanders;
+    int status;
+} ExpansionThread;
+
+static void *expand_commands( void *arg )
+{
+    ExpansionThread *expansion = arg;
+
+    expansion->status = run_batch( expansion->in_fd, expansion->out_fd, expansion->aliases,
+                                   expansion->n_expanders );
+    close( expansion->out_fd );
+
+    return NULL;
+}
+
+int run_aggregate( int in_fd, AliasTable *aliases, int n_expanders, int by_name,
+                   int top, int max_keys )
+{
+    ExpansionThread expansion;
+    Aggregate *aggregate;
+    int pipe_fds[2];
+    char *buffer;
+    size_t size = READ_SIZE;
+    size_t used = 0;
+    size_t start;
+    char *newline;
+    ssize_t n;
+    int status = 0;
+
+    if ( pipe( pipe_fds ) != 0 ) {
+        warn( "Unable to create a pipe" );
+        return 1;
+    }
+
+    expansion.in_fd = in_fd;
+    expansion.out_fd = pipe_fds[1];
+    expansion.aliases = aliases;
+    expansion.n_expanders = n_expanders;
+    expansion.status = 0;
+    pthread_create( &(expansion.thread), NULL, expand_commands, &expansion );
+
+    aggregate = new_aggregate( max_keys );
+    buffer = allocate( size );
+
+    for ( ;; ) {
+        n = read( pipe_fds[0], &(buffer[used]), size - used );
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            warn( "Unable to read the expanded commands" );
+            status = 1;
+            break;
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        used += n;
+
+        /* Count every complete line, and make room for the rest of a
+           line which fills the whole buffer. */
+
+        start = 0;
+        while ( (newline = memchr( &(buffer[start]), '\n', used - start )) != NULL ) {
+            count_line( aggregate, by_name, &(buffer[start]), newline - &(buffer[start]) );
+            start = newline - buffer + 1;
+        }
+
+        if ( (start == 0) && (used == size) ) {
+            size *= 2;
+            buffer = reallocate( buffer, size );
+            continue;
+        }
+
+        memmove( buffer, &(buffer[start]), used - start );
+        used -= start;
+    }
+
+    close( pipe_fds[0] );
+    pthread_join( expansion.thread, NULL );
+
+    print_top_keys( aggregate, stdout, top );
+
+    deallocate( buffer );
+    free_aggregate( aggregate );
+
+    return status || expansion.status;
+}
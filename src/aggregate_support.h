@@ -0,0 +1,78 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __AGGREGATE_SUPPORT_H__
+#define __AGGREGATE_SUPPORT_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "alias_support.h"
+
+/* Aggregate mode counts how often each distinct expanded command, or
+   each command name, turns up in a large log of commands, and reports
+   the most common ones, rather than writing out every expanded
+   command to be put through "sort | uniq -c".
+
+   The counts are kept by the Space-Saving algorithm: a table of at
+   most max_keys keys, each with a count. Until the table is full every
+   count is exact. After that, a new key takes the place of the key
+   with the lowest count, and takes over its count, which it may have
+   over-counted by as much as the count it took over, so the memory
+   used stays bounded however many distinct keys there are. Any key
+   which really occurs more than n / max_keys times in n commands is
+   sure to be in the table. The keys are kept in a min-heap on their
+   counts, so the lowest is always to hand, and found by a hash table
+   of indexes into the heap. */
+
+typedef struct counted_key {
+    char *key;
+    size_t length;
+    unsigned long long hash;
+    unsigned long count;
+    unsigned long error;
+    unsigned int slot;
+} CountedKey;
+
+typedef struct aggregate {
+    CountedKey *heap;
+    int n_keys;
+    int max_keys;
+    int *slots;
+    unsigned int n_slots;
+    unsigned long total;
+    unsigned long replaced;
+} Aggregate;
+
+Aggregate *new_aggregate( int max_keys );
+
+void free_aggregate( Aggregate *aggregate );
+
+void count_key( Aggregate *aggregate, const char *key, size_t length );
+
+void print_top_keys( Aggregate *aggregate, FILE *f, int n );
+
+/* Expand every command read from in_fd, as in batch mode, and print
+   the n most common expanded commands, or with by_name the most
+   common names of the simple commands within them. */
+
+int run_aggregate( int in_fd, AliasTable *aliases, int n_expanders, int by_name,
+                   int top, int max_keys );
+
+
+#endif /* __AGGREGATE_SUPPORT_H__ */
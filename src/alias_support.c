@@ -21,45 +21,723 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/mman.h>
 
 #include "alias_support.h"
+#include "dafsa_support.h"
+#include "allocator_support.h"
 
-Alias *new_alias( Alias *aliases, char *lhs, char *rhs )
+/* Create a new, empty, alias table. */
+
+AliasTable *new_alias_table( void )
+{
+    return allocate_zeroed( 1, sizeof(AliasTable) );
+}
+
+/* Free everything built from the aliases by build_alias_index() and
+   build_perfect_hash(). */
+
+static void free_indexes( AliasTable *table )
+{
+    deallocate( table->filter );
+    table->filter = NULL;
+    table->filter_mask = 0;
+
+    free_dafsa( table->index );
+    table->index = NULL;
+
+    deallocate( table->history );
+    deallocate( table->history_start );
+    deallocate( table->history_count );
+    table->history = NULL;
+    table->n_history = 0;
+    table->history_start = NULL;
+    table->history_count = NULL;
+
+    deallocate( table->perfect_seeds );
+    deallocate( table->perfect_slots );
+    table->perfect_seeds = NULL;
+    table->n_perfect_seeds = 0;
+    table->perfect_slots = NULL;
+    table->n_perfect_slots = 0;
+}
+
+/* Free an alias table, and everything in it. */
+
+void free_alias_table( AliasTable *table )
+{
+    if ( (table != NULL) && !table->is_static ) {
+        free_indexes( table );
+        if ( table->pool_is_mapped ) {
+            munmap( table->pool, table->pool_size );
+        } else {
+            deallocate( table->pool );
+        }
+        deallocate( table->lhs_offset );
+        deallocate( table->lhs_length );
+        deallocate( table->rhs_offset );
+        deallocate( table->rhs_length );
+        deallocate( table->hash );
+        deallocate( table );
+    }
+}
+
+/* A 32 bit FNV-1a hash of the first "length" characters of a word. */
+
+static unsigned int hash_word( const char *word, size_t length )
+{
+    unsigned int hash = 2166136261u;
+    size_t i;
+
+    for ( i = 0; i < length; i++ ) {
+        hash ^= (unsigned char) word[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* The filter has about FILTER_BITS_PER_NAME bits for each alias name,
+   rounded up to a power of two, and sets FILTER_PROBES of them for
+   each name, which lets through about 1% of the words which aren't
+   aliases. The bits are picked by double hashing: the name's hash, and
+   a second hash mixed from it, which is odd so that it steps through
+   every bit. */
+
+#define FILTER_BITS_PER_NAME 10
+#define FILTER_MIN_BITS 64
+#define FILTER_PROBES 4
+
+static unsigned int filter_step( unsigned int hash )
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return hash | 1;
+}
+
+static void add_to_filter( AliasTable *table, unsigned int hash )
+{
+    unsigned int step = filter_step( hash );
+    unsigned int bit;
+    int i;
+
+    for ( i = 0; i < FILTER_PROBES; i++, hash += step ) {
+        bit = hash & table->filter_mask;
+        table->filter[bit / 8] |= (1 << (bit % 8));
+    }
+}
+
+static int in_filter( AliasTable *table, unsigned int hash )
+{
+    unsigned int step = filter_step( hash );
+    unsigned int bit;
+    int i;
+
+    for ( i = 0; i < FILTER_PROBES; i++, hash += step ) {
+        bit = hash & table->filter_mask;
+        if ( (table->filter[bit / 8] & (1 << (bit % 8))) == 0 ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void build_filter( AliasTable *table )
+{
+    size_t bits = FILTER_MIN_BITS;
+    int i;
+
+    while ( bits < (size_t) table->n_aliases * FILTER_BITS_PER_NAME ) {
+        bits *= 2;
+    }
+
+    table->filter = allocate_zeroed( bits / 8, 1 );
+    table->filter_mask = bits - 1;
+
+    for ( i = 0; i < table->n_aliases; i++ ) {
+        add_to_filter( table, table->hash[i] );
+    }
+}
+
+/* Copy "length" characters into the pool, followed by a '\0', and
+   return the offset of the copy. */
+
+static unsigned int add_to_pool( AliasTable *table, const char *s, size_t length )
 {
-    Alias *result;
+    unsigned int offset;
+    char *pool;
 
-    result = malloc( sizeof(Alias) );
-    if ( result != NULL ) {
-        result->lhs = lhs;
-        result->rhs = rhs;
-        result->next = aliases;
+    /* A mapped pool can't grow, so it is copied first. */
+
+    if ( table->pool_is_mapped ) {
+        pool = allocate( table->pool_used );
+        memcpy( pool, table->pool, table->pool_used );
+        munmap( table->pool, table->pool_size );
+        table->pool = pool;
+        table->pool_size = table->pool_used;
+        table->pool_is_mapped = 0;
+    }
+
+    if ( table->pool_used + length + 1 > table->pool_size ) {
+        table->pool_size = 2 * table->pool_size + length + 1;
+        table->pool = reallocate( table->pool, table->pool_size );
     }
 
-    return result;
+    offset = table->pool_used;
+    memcpy( &(table->pool[offset]), s, length );
+    table->pool[offset + length] = '\0';
+    table->pool_used += length + 1;
+
+    return offset;
+}
+
+static void *resize_array( void *array, int n )
+{
+    return reallocate( array, n * sizeof(unsigned int) );
 }
 
+/* Give an empty table a pool which already holds the names and
+   expansions of the aliases, each followed by a '\0', in its first
+   pool_used bytes, for add_pooled_alias(). The table takes the pool,
+   which is either allocated, or if is_mapped is non-zero a private
+   mapping of pool_size bytes, which is copied before anything is
+   added to it with add_alias(). */
+
+void set_alias_pool( AliasTable *table, char *pool, size_t pool_used, size_t pool_size,
+                     int is_mapped )
+{
+    table->pool = pool;
+    table->pool_used = pool_used;
+    table->pool_size = pool_size;
+    table->pool_is_mapped = is_mapped;
+}
+
+/* Add an alias whose name and expansion are already in the pool, at
+   the given offsets, each followed by a '\0'. If an alias is added
+   more than once, the last definition wins. */
+
+void add_pooled_alias( AliasTable *table, unsigned int lhs_offset, size_t lhs_length,
+                       unsigned int rhs_offset, size_t rhs_length )
+{
+    int i = table->n_aliases;
+    unsigned int hash = hash_word( &(table->pool[lhs_offset]), lhs_length );
+
+    if ( i == table->max_aliases ) {
+        table->max_aliases = 2 * table->max_aliases + 16;
+        table->lhs_offset = resize_array( table->lhs_offset, table->max_aliases );
+        table->lhs_length = resize_array( table->lhs_length, table->max_aliases );
+        table->rhs_offset = resize_array( table->rhs_offset, table->max_aliases );
+        table->rhs_length = resize_array( table->rhs_length, table->max_aliases );
+        table->hash = resize_array( table->hash, table->max_aliases );
+    }
+
+    table->lhs_offset[i] = lhs_offset;
+    table->lhs_length[i] = lhs_length;
+    table->rhs_offset[i] = rhs_offset;
+    table->rhs_length[i] = rhs_length;
+    table->hash[i] = hash;
+    table->n_aliases++;
+
+    /* Any index is now out of date. */
+    free_indexes( table );
+}
+
+/* Add an alias to the table. The name and expansion are copied into
+   the table's pool, and don't need to be null terminated. */
+
+void add_alias( AliasTable *table, const char *lhs, size_t lhs_length,
+                const char *rhs, size_t rhs_length )
+{
+    unsigned int lhs_offset = add_to_pool( table, lhs, lhs_length );
+    unsigned int rhs_offset = add_to_pool( table, rhs, rhs_length );
+
+    add_pooled_alias( table, lhs_offset, lhs_length, rhs_offset, rhs_length );
+}
+
+/* Parse the value of every alias into a template, all of them going
+   into the one array of parts. */
+
+static void build_history( AliasTable *table )
+{
+    HistoryPart *parts;
+    unsigned int max_history = 0;
+    int n_parts;
+    int i;
+
+    table->history_start = resize_array( NULL, table->n_aliases );
+    table->history_count = resize_array( NULL, table->n_aliases );
+
+    for ( i = 0; i < table->n_aliases; i++ ) {
+        n_parts = parse_history( alias_value( table, i ), &parts );
+
+        if ( table->n_history + n_parts > max_history ) {
+            max_history = 2 * max_history + n_parts;
+            table->history = reallocate( table->history, max_history * sizeof(HistoryPart) );
+        }
+        if ( n_parts > 0 ) {
+            memcpy( &(table->history[table->n_history]), parts, n_parts * sizeof(HistoryPart) );
+        }
+        table->history_start[i] = table->n_history;
+        table->history_count[i] = n_parts;
+        table->n_history += n_parts;
+
+        deallocate( parts );
+    }
+
+    if ( (table->n_history > 0) && (table->n_history < max_history) ) {
+        table->history = reallocate( table->history, table->n_history * sizeof(HistoryPart) );
+    }
+}
+
+/* Build the index over the alias names. This should be called once
+   all the aliases have been added, and also gives back any memory
+   that the pool and arrays had grown into but didn't need. */
+
+void build_alias_index( AliasTable *table )
+{
+    if ( !table->pool_is_mapped && (table->pool_used < table->pool_size) ) {
+        table->pool_size = table->pool_used;
+        table->pool = reallocate( table->pool, table->pool_size );
+    }
+
+    if ( (table->n_aliases > 0) && (table->n_aliases < table->max_aliases) ) {
+        table->max_aliases = table->n_aliases;
+        table->lhs_offset = resize_array( table->lhs_offset, table->max_aliases );
+        table->lhs_length = resize_array( table->lhs_length, table->max_aliases );
+        table->rhs_offset = resize_array( table->rhs_offset, table->max_aliases );
+        table->rhs_length = resize_array( table->rhs_length, table->max_aliases );
+        table->hash = resize_array( table->hash, table->max_aliases );
+    }
+
+    free_indexes( table );
+    build_filter( table );
+    table->index = build_dafsa( table );
+    build_history( table );
+}
+
+/* The name of an alias, and what it expands to. Both point into the
+   table's pool, and must not be freed. */
+
+char *alias_name( AliasTable *table, int alias )
+{
+    return &(table->pool[table->lhs_offset[alias]]);
+}
+
+char *alias_value( AliasTable *table, int alias )
+{
+    return &(table->pool[table->rhs_offset[alias]]);
+}
+
+/* The template for an alias's value, which points into the table.
+   Returns the number of parts, or -1 if the templates haven't been
+   built. */
+
+int alias_history( AliasTable *table, int alias, const HistoryPart **parts )
+{
+    if ( table->history_start == NULL ) {
+        return -1;
+    }
+
+    *parts = &(table->history[table->history_start[alias]]);
+    return table->history_count[alias];
+}
+
+/* Returns zero if the first "length" characters of word are
+   definitely not the name of an alias, and non-zero if they might
+   be, as any word might until the filter has been built. Only needs
+   the word's bytes, so the caller doesn't have to make a copy of it
+   first. */
+
+int might_be_alias( AliasTable *table, const char *word, size_t length )
+{
+    unsigned int hash;
+
+    if ( table == NULL ) {
+        return 0;
+    }
+
+    __atomic_add_fetch( &(table->lookups), 1, __ATOMIC_RELAXED );
+
+    hash = hash_word( word, length );
+    if ( (table->filter == NULL) || in_filter( table, hash ) ) {
+        return 1;
+    } else {
+        __atomic_add_fetch( &(table->rejects), 1, __ATOMIC_RELAXED );
+        return 0;
+    }
+}
 
 /* Print the expansion of all known aliases. */
 
-void print_aliases( Alias *a )
+void print_aliases( AliasTable *table )
+{
+    int i;
+
+    for ( i = 0; (table != NULL) && (i < table->n_aliases); i++ ) {
+        fprintf( stderr, "Alias: (%s) expands to: (%s)\n",
+                 alias_name( table, i ), alias_value( table, i ) );
+    }
+}
+
+/* Pick the slot for a name, hashing it again starting from the seed
+   chosen for it by build_perfect_hash(). Hashing the name itself,
+   rather than mixing the seed into its hash, means that two names
+   with the same hash can still be given different slots. The mixing
+   at the end is the finaliser of MurmurHash3, which spreads a change
+   in any bit of its input over all of its output. */
+
+static unsigned int perfect_slot( const char *name, size_t length, unsigned int seed,
+                                  unsigned int n_slots )
+{
+    unsigned int hash = 2166136261u ^ (seed * 0x9e3779b9u);
+    size_t i;
+
+    for ( i = 0; i < length; i++ ) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return hash & (n_slots - 1);
+}
+
+static int is_named( AliasTable *table, int i, unsigned int hash,
+                     const char *word, size_t length )
 {
-    while ( a != NULL ) {
-        fprintf( stderr, "Alias: (%s) expands to: (%s)\n", a->lhs, a->rhs );
-        a = a->next;
+    return (table->hash[i] == hash) && (table->lhs_length[i] == length) &&
+           (memcmp( alias_name( table, i ), word, length ) == 0);
+}
+
+/* Find an alias by name, as for find_alias(), but without counting the
+   lookup. */
+
+static int find_name( AliasTable *table, const char *word, size_t length )
+{
+    unsigned int hash;
+    int i;
+
+    if ( table->perfect_slots != NULL ) {
+        hash = hash_word( word, length );
+        i = table->perfect_slots[perfect_slot( word, length,
+                                               table->perfect_seeds[hash & (table->n_perfect_seeds - 1)],
+                                               table->n_perfect_slots )];
+        if ( (i != NO_ALIAS) && !is_named( table, i, hash, word, length ) ) {
+            i = NO_ALIAS;
+        }
+    } else if ( table->index != NULL ) {
+        i = dafsa_lookup( table->index, word, length );
+    } else {
+        hash = hash_word( word, length );
+        for ( i = table->n_aliases - 1; i >= 0; i-- ) {
+            if ( is_named( table, i, hash, word, length ) ) {
+                break;
+            }
+        }
     }
+
+    return i;
+}
+
+/* Find the alias whose name is the first "length" characters of
+   word, which need not be null terminated. Uses the perfect hash or
+   the index if there is one, and otherwise searches the arrays from
+   the end, so that later definitions hide earlier ones. Returns the
+   alias, or NO_ALIAS. */
+
+int find_alias( AliasTable *table, const char *word, size_t length )
+{
+    int i;
+
+    if ( table == NULL ) {
+        return NO_ALIAS;
+    }
+
+    i = find_name( table, word, length );
+
+    if ( i != NO_ALIAS ) {
+        __atomic_add_fetch( &(table->hits), 1, __ATOMIC_RELAXED );
+    }
+
+    return i;
+}
+
+/* The seeds tried for each bucket of names before giving up and trying
+   again with twice as many slots, and how many times to try that. */
+
+#define MAX_PERFECT_SEED 65536
+#define MAX_PERFECT_DOUBLINGS 4
+
+static unsigned int power_of_two_at_least( unsigned int n )
+{
+    unsigned int power = 1;
+
+    while ( power < n ) {
+        power *= 2;
+    }
+
+    return power;
+}
+
+/* Try to place every bucket of names, largest first, each with the
+   first seed which puts all of its names into empty slots. The names
+   are in "names", grouped by bucket, with bucket b's starting at
+   first[b], and the low 32 bits of each of "order" are a bucket.
+   Returns -1 if some bucket can't be placed. */
+
+static int place_buckets( AliasTable *table, int *names, unsigned int *first,
+                          unsigned long long *order )
+{
+    unsigned int b;
+    unsigned int j;
+    unsigned int k;
+    unsigned int seed;
+    unsigned int slot;
+    unsigned int bucket;
+    int i;
+
+    for ( b = 0; b < table->n_perfect_seeds; b++ ) {
+        bucket = (unsigned int) order[b];
+        if ( first[bucket] == first[bucket + 1] ) {
+            break;
+        }
+
+        for ( seed = 0; seed < MAX_PERFECT_SEED; seed++ ) {
+            for ( j = first[bucket]; j < first[bucket + 1]; j++ ) {
+                i = names[j];
+                slot = perfect_slot( alias_name( table, i ), table->lhs_length[i], seed,
+                                     table->n_perfect_slots );
+                if ( table->perfect_slots[slot] != NO_ALIAS ) {
+                    break;
+                }
+                table->perfect_slots[slot] = names[j];
+            }
+
+            if ( j == first[bucket + 1] ) {
+                break;
+            }
+
+            /* Take back the names placed with this seed. */
+
+            for ( k = first[bucket]; k < j; k++ ) {
+                i = names[k];
+                table->perfect_slots[perfect_slot( alias_name( table, i ), table->lhs_length[i],
+                                                   seed, table->n_perfect_slots )] = NO_ALIAS;
+            }
+        }
+
+        if ( seed == MAX_PERFECT_SEED ) {
+            return -1;
+        }
+        table->perfect_seeds[bucket] = seed;
+    }
+
+    return 0;
+}
+
+/* Sorts the buckets largest first. */
+
+static int compare_buckets( const void *a, const void *b )
+{
+    unsigned long long bucket_a = *(const unsigned long long *) a;
+    unsigned long long bucket_b = *(const unsigned long long *) b;
+
+    return (bucket_a < bucket_b) - (bucket_a > bucket_b);
 }
 
-/* If there is an alias which matches the command, return its expansion, otherwise NULL. */
+/* Build a perfect hash over the names of the aliases, which then takes
+   the place of any other index. Only the last definition of a name is
+   put in it. There are about half as many buckets of names, and so
+   seeds, as there are names, and at least a quarter more slots than
+   names. Returns -1, and leaves the table with its usual index, if no
+   perfect hash could be found. */
 
-char *lookup_alias( char *cmd, Alias *a )
+int build_perfect_hash( AliasTable *table )
 {
-    while ( (a != NULL) && (strcmp( cmd, a->lhs ) != 0) ) {
-        a = a->next;
+    unsigned long long *order;
+    unsigned int *first;
+    unsigned int *next;
+    unsigned int bucket;
+    unsigned int b;
+    int *names;
+    int *sorted;
+    int n_names = 0;
+    int status = -1;
+    int doublings = 0;
+    int i;
+
+    names = allocate( (table->n_aliases + 1) * sizeof(int) );
+    for ( i = 0; i < table->n_aliases; i++ ) {
+        if ( find_name( table, alias_name( table, i ), table->lhs_length[i] ) == i ) {
+            names[n_names++] = i;
+        }
+    }
+
+    free_indexes( table );
+
+    table->n_perfect_seeds = power_of_two_at_least( (n_names + 1) / 2 );
+    table->n_perfect_slots = power_of_two_at_least( n_names + n_names / 4 );
+    table->perfect_seeds = allocate_zeroed( table->n_perfect_seeds, sizeof(unsigned int) );
+
+    /* Sort the names by bucket, and the buckets by size, keeping each
+       bucket's size in the high bits of "order". */
+
+    first = allocate_zeroed( table->n_perfect_seeds + 1, sizeof(unsigned int) );
+    next = allocate_zeroed( table->n_perfect_seeds, sizeof(unsigned int) );
+    order = allocate( table->n_perfect_seeds * sizeof(unsigned long long) );
+    sorted = allocate( (n_names + 1) * sizeof(int) );
+
+    for ( i = 0; i < n_names; i++ ) {
+        first[(table->hash[names[i]] & (table->n_perfect_seeds - 1)) + 1]++;
+    }
+    for ( b = 0; b < table->n_perfect_seeds; b++ ) {
+        order[b] = ((unsigned long long) first[b + 1] << 32) | b;
+        first[b + 1] += first[b];
+        next[b] = first[b];
+    }
+    for ( i = 0; i < n_names; i++ ) {
+        bucket = table->hash[names[i]] & (table->n_perfect_seeds - 1);
+        sorted[next[bucket]++] = names[i];
+    }
+    qsort( order, table->n_perfect_seeds, sizeof(unsigned long long), compare_buckets );
+
+    while ( (status < 0) && (doublings <= MAX_PERFECT_DOUBLINGS) ) {
+        table->perfect_slots = reallocate( table->perfect_slots,
+                                           table->n_perfect_slots * sizeof(int) );
+        memset( table->perfect_slots, 0xff, table->n_perfect_slots * sizeof(int) );
+
+        status = place_buckets( table, sorted, first, order );
+        if ( status < 0 ) {
+            table->n_perfect_slots *= 2;
+            doublings++;
+        }
+    }
+
+    if ( status < 0 ) {
+        build_alias_index( table );
+    } else {
+        build_filter( table );
+        build_history( table );
     }
 
-    if ( a != NULL ) {
-        return strdup( a->rhs );
+    deallocate( names );
+    deallocate( sorted );
+    deallocate( first );
+    deallocate( next );
+    deallocate( order );
+
+    return status;
+}
+
+/* If there is an alias which matches the command, return a copy of its expansion, otherwise NULL. */
+
+char *lookup_alias( char *cmd, AliasTable *table )
+{
+    int alias = find_alias( table, cmd, strlen( cmd ) );
+
+    if ( alias != NO_ALIAS ) {
+        return copy_string( alias_value( table, alias ) );
     } else {
         return NULL;
     }
 }
+
+/* The number of bytes used by the table and its templates, not
+   counting the index. */
+
+size_t alias_table_size( AliasTable *table )
+{
+    if ( table == NULL ) {
+        return 0;
+    }
+
+    return sizeof(AliasTable) + table->pool_size +
+        5 * table->max_aliases * sizeof(unsigned int) +
+        ((table->history_start != NULL) ? 2 * table->n_aliases * sizeof(unsigned int) : 0) +
+        table->n_history * sizeof(HistoryPart);
+}
+
+/* The number of bytes used by the filter and whichever index the
+   table has. */
+
+size_t alias_index_size( AliasTable *table )
+{
+    if ( table == NULL ) {
+        return 0;
+    }
+
+    return ((table->filter != NULL) ? (table->filter_mask + 1) / 8 : 0) +
+        dafsa_size( table->index ) +
+        (table->n_perfect_seeds + table->n_perfect_slots) * sizeof(unsigned int);
+}
+
+/* Roughly the number of bytes that glibc's malloc uses for an
+   allocation of "size" bytes. */
+
+static size_t malloc_chunk_size( size_t size )
+{
+    size_t chunk = (size + sizeof(size_t) + 15) & ~((size_t) 15);
+
+    return (chunk < 32) ? 32 : chunk;
+}
+
+/* The number of bytes which the same aliases would have needed when
+   each one was a separately allocated list node holding separately
+   allocated copies of its name and expansion. */
+
+size_t alias_list_size( AliasTable *table )
+{
+    size_t size = 0;
+    int i;
+
+    for ( i = 0; (table != NULL) && (i < table->n_aliases); i++ ) {
+        size += malloc_chunk_size( 3 * sizeof(char *) );
+        size += malloc_chunk_size( table->lhs_length[i] + 1 );
+        size += malloc_chunk_size( table->rhs_length[i] + 1 );
+    }
+
+    return size;
+}
+
+/* Print statistics about the table and how it has been used. Commands
+   which are rejected by the filter are passed through without any
+   further work, so the reject rate is the one we care about most. */
+
+void print_alias_stats( AliasTable *table )
+{
+    unsigned long lookups = 0;
+    unsigned long rejects = 0;
+    unsigned long hits = 0;
+    int n_aliases = 0;
+    size_t table_size = alias_table_size( table );
+    size_t list_size = alias_list_size( table );
+    size_t index_size = alias_index_size( table );
+
+    if ( table != NULL ) {
+        lookups = table->lookups;
+        rejects = table->rejects;
+        hits = table->hits;
+        n_aliases = table->n_aliases;
+    }
+
+    fprintf( stderr, "Aliases: %d\n", n_aliases );
+    fprintf( stderr, "Table memory: %zu bytes (%.1f per alias)\n", table_size,
+             (n_aliases > 0) ? ((double) table_size / n_aliases) : 0.0 );
+    fprintf( stderr, "Table memory as a list: %zu bytes (%.1f per alias)\n", list_size,
+             (n_aliases > 0) ? ((double) list_size / n_aliases) : 0.0 );
+    fprintf( stderr, "Index memory: %zu bytes\n", index_size );
+    fprintf( stderr, "Lookups: %lu\n", lookups );
+    fprintf( stderr, "Alias hits: %lu\n", hits );
+    fprintf( stderr, "Filter rejects: %lu (%.1f%%)\n", rejects,
+             (lookups > 0) ? (100.0 * rejects / lookups) : 0.0 );
+    fprintf( stderr, "Filter false positives: %lu\n", lookups - rejects - hits );
+}
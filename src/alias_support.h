@@ -19,18 +19,119 @@
 #ifndef __ALIAS_SUPPORT_H__
 #define __ALIAS_SUPPORT_H__
 
-typedef struct alias {
-    struct alias *next;
-    char *lhs;
-    char *rhs;
-} Alias;
+#include <stddef.h>
 
-Alias *new_alias( Alias *aliases, char *lhs, char *rhs );
+#include "history_support.h"
 
-char *lookup_alias( char *cmd, Alias *a );
+/* The aliases are stored as a "struct of arrays". All the names and
+   expansions are packed, each followed by a '\0', into one pool of
+   characters, and alias i is described by the i'th entry of each of
+   the parallel arrays below. This keeps a table of N aliases down to
+   a handful of allocations, rather than 3N small ones, and means that
+   searching the table only touches the arrays it needs. Aliases are
+   identified by their index in the arrays. */
 
-void print_aliases( Alias *a );
+#define NO_ALIAS (-1)
 
+/* Most commands that we see are not aliases at all, so as well as the
+   aliases themselves the table holds a Bloom filter over the alias
+   names, which build_alias_index() sizes to the number of aliases. If
+   a word fails the filter it can't possibly be an alias, and we don't
+   need to look any further. */
 
-#endif /* __ALIAS_SUPPORT_H__ */
+/* Once the table has been loaded, build_alias_index() builds an
+   automaton over the names (see dafsa_support.h) so that a lookup
+   doesn't have to look at every alias. It also parses each alias's
+   value into a template (see history_support.h), so that expanding an
+   alias doesn't have to parse its value again.
+
+   A table compiled into the program by -emit-c has a perfect hash over
+   the names instead, built by build_perfect_hash(): the hash of a name
+   picks a seed, and hashing the name again from that seed picks the
+   only slot which can hold it. Unlike the automaton, it is made of nothing but
+   arrays of integers, so it can be written out as constant data. */
+
+typedef struct alias_table {
+    char *pool;
+    size_t pool_used;
+    size_t pool_size;
+
+    /* The pool may be an alias file mapped into memory (see
+       set_alias_pool()), which is unmapped rather than freed. */
+    int pool_is_mapped;
+
+    int n_aliases;
+    int max_aliases;
+    unsigned int *lhs_offset;
+    unsigned int *lhs_length;
+    unsigned int *rhs_offset;
+    unsigned int *rhs_length;
+    unsigned int *hash;
+
+    unsigned char *filter;
+    unsigned int filter_mask;
+    struct dafsa *index;
+
+    /* Alias i's template is history_count[i] parts of history, starting
+       at history_start[i]. */
+    HistoryPart *history;
+    unsigned int n_history;
+    unsigned int *history_start;
+    unsigned int *history_count;
+
+    unsigned int *perfect_seeds;
+    unsigned int n_perfect_seeds;
+    int *perfect_slots;
+    unsigned int n_perfect_slots;
+
+    /* A table compiled into the program isn't freed. */
+    int is_static;
+
+    /* Counters reported by print_alias_stats(). A server may share a
+       table between threads, so these are updated atomically. */
+    unsigned long lookups;
+    unsigned long rejects;
+    unsigned long hits;
+} AliasTable;
+
+AliasTable *new_alias_table( void );
+
+void free_alias_table( AliasTable *table );
+
+void add_alias( AliasTable *table, const char *lhs, size_t lhs_length,
+                const char *rhs, size_t rhs_length );
+
+void set_alias_pool( AliasTable *table, char *pool, size_t pool_used, size_t pool_size,
+                     int is_mapped );
+
+void add_pooled_alias( AliasTable *table, unsigned int lhs_offset, size_t lhs_length,
+                       unsigned int rhs_offset, size_t rhs_length );
 
+void build_alias_index( AliasTable *table );
+
+int build_perfect_hash( AliasTable *table );
+
+char *alias_name( AliasTable *table, int alias );
+
+char *alias_value( AliasTable *table, int alias );
+
+int alias_history( AliasTable *table, int alias, const HistoryPart **parts );
+
+int might_be_alias( AliasTable *table, const char *word, size_t length );
+
+int find_alias( AliasTable *table, const char *word, size_t length );
+
+char *lookup_alias( char *cmd, AliasTable *table );
+
+size_t alias_table_size( AliasTable *table );
+
+size_t alias_index_size( AliasTable *table );
+
+size_t alias_list_size( AliasTable *table );
+
+void print_aliases( AliasTable *table );
+
+void print_alias_stats( AliasTable *table );
+
+
+#endif /* __ALIAS_SUPPORT_H__ */
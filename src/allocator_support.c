@@ -0,0 +1,224 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "allocator_support.h"
+
+static void *libc_allocate( void *context, size_t size )
+{
+    return malloc( size );
+}
+
+static void *libc_reallocate( void *context, void *p, size_t size )
+{
+    return realloc( p, size );
+}
+
+static void libc_deallocate( void *context, void *p )
+{
+    free( p );
+}
+
+static Allocator libc_allocator = {
+    libc_allocate,
+    libc_reallocate,
+    libc_deallocate,
+    NULL
+};
+
+static Allocator *current = &libc_allocator;
+
+/* Use an allocator, or malloc again if it is NULL. */
+
+void set_allocator( Allocator *allocator )
+{
+    current = (allocator != NULL) ? allocator : &libc_allocator;
+}
+
+/* Nothing which allocates memory is prepared for there not to be any,
+   so give up straight away. */
+
+static void *check_allocation( void *p )
+{
+    if ( p == NULL ) {
+        warnx( "Out of memory" );
+        abort();
+    }
+
+    return p;
+}
+
+void *allocate( size_t size )
+{
+    return check_allocation( current->allocate( current->context, (size > 0) ? size : 1 ) );
+}
+
+void *allocate_zeroed( size_t n, size_t size )
+{
+    void *p = allocate( n * size );
+
+    memset( p, 0, n * size );
+    return p;
+}
+
+void *reallocate( void *p, size_t size )
+{
+    return check_allocation( current->reallocate( current->context, p, (size > 0) ? size : 1 ) );
+}
+
+void deallocate( void *p )
+{
+    if ( p != NULL ) {
+        current->deallocate( current->context, p );
+    }
+}
+
+char *copy_string( const char *s )
+{
+    return copy_substring( s, strlen( s ) );
+}
+
+/* Copy up to length characters of a string, as strndup() does. */
+
+char *copy_substring( const char *s, size_t length )
+{
+    char *result;
+    const char *end = memchr( s, '\0', length );
+
+    if ( end != NULL ) {
+        length = end - s;
+    }
+
+    result = allocate( length + 1 );
+    memcpy( result, s, length );
+    result[length] = '\0';
+
+    return result;
+}
+
+/* Each block in a fixed buffer starts with its size, and is aligned
+   so that it can hold anything. */
+
+#define ALIGNMENT 16
+
+#define BLOCK_HEADER ALIGNMENT
+
+#define ALIGN(n) (((n) + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1))
+
+static size_t block_size( char *p )
+{
+    return *(size_t *) (p - BLOCK_HEADER);
+}
+
+static void *fixed_allocate( void *context, size_t size )
+{
+    FixedBuffer *buffer = context;
+    char *p;
+
+    if ( ALIGN( size ) + BLOCK_HEADER > buffer->size - buffer->used ) {
+        return NULL;
+    }
+
+    p = &(buffer->memory[buffer->used + BLOCK_HEADER]);
+    *(size_t *) (p - BLOCK_HEADER) = size;
+
+    buffer->last = buffer->used;
+    buffer->used += BLOCK_HEADER + ALIGN( size );
+
+    return p;
+}
+
+/* The last block can simply grow or shrink, which is usually the case
+   when a string is built up bit by bit. Anything else has to move. */
+
+static void *fixed_reallocate( void *context, void *p, size_t size )
+{
+    FixedBuffer *buffer = context;
+    char *block = p;
+    char *result;
+    size_t old_size;
+
+    if ( p == NULL ) {
+        return fixed_allocate( context, size );
+    }
+
+    old_size = block_size( block );
+
+    if ( block == &(buffer->memory[buffer->last + BLOCK_HEADER]) ) {
+        if ( ALIGN( size ) + BLOCK_HEADER > buffer->size - buffer->last ) {
+            return NULL;
+        }
+        *(size_t *) (block - BLOCK_HEADER) = size;
+        buffer->used = buffer->last + BLOCK_HEADER + ALIGN( size );
+        return p;
+    }
+
+    result = fixed_allocate( context, size );
+    if ( result != NULL ) {
+        memcpy( result, p, (size < old_size) ? size : old_size );
+    }
+
+    return result;
+}
+
+static void fixed_deallocate( void *context, void *p )
+{
+    FixedBuffer *buffer = context;
+
+    if ( (char *) p == &(buffer->memory[buffer->last + BLOCK_HEADER]) ) {
+        buffer->used = buffer->last;
+    }
+}
+
+/* Set up a fixed buffer in size bytes of memory, returning the
+   allocator to pass to set_allocator(). */
+
+Allocator *init_fixed_buffer( FixedBuffer *buffer, void *memory, size_t size )
+{
+    size_t skip = ALIGN( (size_t) memory ) - (size_t) memory;
+
+    buffer->memory = (char *) memory + skip;
+    buffer->size = (size > skip) ? size - skip : 0;
+    buffer->used = 0;
+    buffer->last = 0;
+
+    buffer->allocator.allocate = fixed_allocate;
+    buffer->allocator.reallocate = fixed_reallocate;
+    buffer->allocator.deallocate = fixed_deallocate;
+    buffer->allocator.context = buffer;
+
+    return &(buffer->allocator);
+}
+
+size_t fixed_buffer_mark( FixedBuffer *buffer )
+{
+    return buffer->used;
+}
+
+/* Free everything allocated since the mark was taken. */
+
+void fixed_buffer_reset( FixedBuffer *buffer, size_t mark )
+{
+    buffer->used = mark;
+    buffer->last = mark;
+}
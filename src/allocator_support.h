@@ -0,0 +1,76 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ALLOCATOR_SUPPORT_H__
+#define __ALLOCATOR_SUPPORT_H__
+
+#include <stddef.h>
+
+/* All the memory used for alias tables and for expanding commands
+   comes from the current allocator, which is normally just malloc.
+   A program which can't call malloc, for example because it is
+   itself intercepting malloc, can install its own allocator, or use
+   a fixed buffer.
+
+   The allocator should be set before anything is allocated, and
+   anything allocated must be freed with deallocate(), and not with
+   free(). Expanded commands, for example, are allocated like this. */
+
+typedef struct allocator {
+    void *(*allocate)( void *context, size_t size );
+    void *(*reallocate)( void *context, void *p, size_t size );
+    void (*deallocate)( void *context, void *p );
+    void *context;
+} Allocator;
+
+void set_allocator( Allocator *allocator );
+
+void *allocate( size_t size );
+
+void *allocate_zeroed( size_t n, size_t size );
+
+void *reallocate( void *p, size_t size );
+
+void deallocate( void *p );
+
+char *copy_string( const char *s );
+
+char *copy_substring( const char *s, size_t length );
+
+/* An allocator which hands out memory from a fixed buffer. Memory is
+   only given back when it was the last to be allocated, so usually
+   the whole buffer is reset once a command has been expanded, to the
+   mark taken before. It isn't thread safe. */
+
+typedef struct fixed_buffer {
+    char *memory;
+    size_t size;
+    size_t used;
+    size_t last;
+    Allocator allocator;
+} FixedBuffer;
+
+Allocator *init_fixed_buffer( FixedBuffer *buffer, void *memory, size_t size );
+
+size_t fixed_buffer_mark( FixedBuffer *buffer );
+
+void fixed_buffer_reset( FixedBuffer *buffer, size_t mark );
+
+
+#endif /* __ALLOCATOR_SUPPORT_H__ */
@@ -0,0 +1,313 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <pthread.h>
+
+#include "alias_support.h"
+#include "dealias_support.h"
+#include "ring_support.h"
+#include "batch_support.h"
+#include "allocator_support.h"
+
+/* The reader reads up to this much at a time, and each batch holds
+   the complete lines from one read, so that input which arrives a
+   little at a time, such as from a terminal, is expanded as it
+   arrives. */
+
+#define BLOCK_SIZE (1024 * 1024)
+
+/* How many batches can be waiting between one stage and the next. */
+
+#define RING_SIZE 8
+
+typedef struct batch {
+    char *in;
+    size_t in_used;
+    char *out;
+    size_t out_used;
+    size_t out_size;
+} Batch;
+
+typedef struct expander {
+    pthread_t thread;
+    Ring *input;
+    Ring *output;
+    AliasTable *aliases;
+    unsigned long failed;
+} Expander;
+
+typedef struct writer {
+    pthread_t thread;
+    Expander *expanders;
+    int n_expanders;
+    int fd;
+    int failed;
+} Writer;
+
+static void append_output( Batch *batch, char *s, size_t length )
+{
+    if ( batch->out_used + length > batch->out_size ) {
+        batch->out_size = 2 * batch->out_size + length;
+        batch->out = realloc( batch->out, batch->out_size );
+    }
+
+    memcpy( &(batch->out[batch->out_used]), s, length );
+    batch->out_used += length;
+}
+
+/* Expand every line in a batch. A line which can't be expanded within
+   the limits (see set_expansion_limits()) is reported, and an empty
+   line written in its place, so that the results still line up with
+   the commands. Returns the number of such lines. */
+
+static unsigned long expand_batch( Batch *batch, AliasTable *aliases )
+{
+    unsigned long failed = 0;
+    char *line = batch->in;
+    char *end = batch->in + batch->in_used;
+    char *newline;
+    char *result;
+
+    batch->out_size = batch->in_used + batch->in_used / 2 + 1;
+    batch->out = malloc( batch->out_size );
+
+    while ( line < end ) {
+        newline = memchr( line, '\n', end - line );
+        *newline = '\0';
+
+        result = dealias_command_line( line, aliases );
+        if ( result != NULL ) {
+            append_output( batch, result, strlen( result ) );
+            deallocate( result );
+        } else {
+            warnx( "Unable to expand \"%.40s%s\": %s", line,
+                   (strlen( line ) > 40) ? "..." : "", expansion_error_message( errno ) );
+            failed++;
+        }
+        append_output( batch, "\n", 1 );
+
+        line = newline + 1;
+    }
+
+    free( batch->in );
+    batch->in = NULL;
+
+    return failed;
+}
+
+/* An expander thread. A NULL batch marks the end of the input, and is
+   passed on to the writer. */
+
+static void *expand( void *arg )
+{
+    Expander *expander = arg;
+    Batch *batch;
+
+    do {
+        batch = ring_get( expander->input );
+        if ( batch != NULL ) {
+            expander->failed += expand_batch( batch, expander->aliases );
+        }
+        ring_put( expander->output, batch );
+    } while ( batch != NULL );
+
+    return NULL;
+}
+
+static int write_all( int fd, char *data, size_t length )
+{
+    ssize_t n;
+
+    while ( length > 0 ) {
+        n = write( fd, data, length );
+        if ( n > 0 ) {
+            data += n;
+            length -= n;
+        } else if ( errno != EINTR ) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* The writer thread takes the batches from the expanders in the same
+   order as the reader handed them out. The first NULL it sees is the
+   end of the output. After a write error it carries on taking batches,
+   so that the other threads can finish. */
+
+static void *write_batches( void *arg )
+{
+    Writer *writer = arg;
+    Batch *batch;
+    int i = 0;
+
+    while ( (batch = ring_get( writer->expanders[i].output )) != NULL ) {
+        if ( !writer->failed && (write_all( writer->fd, batch->out, batch->out_used ) < 0) ) {
+            warn( "Unable to write output" );
+            writer->failed = 1;
+        }
+
+        free( batch->out );
+        free( batch );
+
+        i = (i + 1) % writer->n_expanders;
+    }
+
+    return NULL;
+}
+
+/* Read the input in large blocks, and hand out batches of complete
+   lines to the expanders in turn, as soon as a read gives us any. Any
+   partial line at the end of a block is carried over to the start of
+   the next. Every block has a spare byte at the end, so that a final
+   line can be given a '\n'. Returns -1 on a read error. */
+
+static int read_batches( int fd, Expander *expanders, int n_expanders )
+{
+    Batch *batch;
+    size_t size = BLOCK_SIZE;
+    char *block = malloc( size + 1 );
+    size_t used = 0;
+    size_t length;
+    char *last_newline;
+    ssize_t n;
+    int at_end = 0;
+    int status = 0;
+    int i = 0;
+    int j;
+
+    while ( !at_end ) {
+        n = read( fd, &(block[used]), size - used );
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            warn( "Unable to read input" );
+            status = -1;
+            at_end = 1;
+        } else if ( n == 0 ) {
+            at_end = 1;
+        } else {
+            used += n;
+        }
+
+        if ( at_end && (used > 0) && (block[used-1] != '\n') ) {
+            block[used++] = '\n';
+        }
+
+        last_newline = memrchr( block, '\n', used );
+        if ( last_newline == NULL ) {
+            if ( !at_end && (used == size) ) {
+                /* A single line longer than a block. */
+                size *= 2;
+                block = realloc( block, size + 1 );
+            }
+            continue;
+        }
+
+        /* The batch takes the block, and the partial line is copied to
+           a new one. */
+
+        length = (last_newline - block) + 1;
+
+        batch = calloc( 1, sizeof(Batch) );
+        batch->in = block;
+        batch->in_used = length;
+
+        size = BLOCK_SIZE;
+        while ( size <= used - length ) {
+            size *= 2;
+        }
+        block = malloc( size + 1 );
+        used -= length;
+        memcpy( block, &(batch->in[length]), used );
+
+        ring_put( expanders[i].input, batch );
+        i = (i + 1) % n_expanders;
+    }
+
+    free( block );
+
+    /* Tell every expander that there is nothing more to come, starting
+       with the one whose turn it is, so the writer sees the end in the
+       right place. */
+
+    for ( j = 0; j < n_expanders; j++ ) {
+        ring_put( expanders[(i + j) % n_expanders].input, NULL );
+    }
+
+    return status;
+}
+
+/* Expand every command read from in_fd, and write the results to
+   out_fd, using n_expanders threads to do the expansion, or one per
+   processor if n_expanders is zero. Returns non-zero on an error. */
+
+int run_batch( int in_fd, int out_fd, AliasTable *aliases, int n_expanders )
+{
+    Expander *expanders;
+    Writer writer;
+    unsigned long failed = 0;
+    int status;
+    int i;
+
+    if ( n_expanders <= 0 ) {
+        n_expanders = sysconf( _SC_NPROCESSORS_ONLN );
+        if ( n_expanders <= 0 ) {
+            n_expanders = 1;
+        }
+    }
+
+    expanders = calloc( n_expanders, sizeof(Expander) );
+    for ( i = 0; i < n_expanders; i++ ) {
+        expanders[i].input = new_ring( RING_SIZE );
+        expanders[i].output = new_ring( RING_SIZE );
+        expanders[i].aliases = aliases;
+        pthread_create( &(expanders[i].thread), NULL, expand, &(expanders[i]) );
+    }
+
+    writer.expanders = expanders;
+    writer.n_expanders = n_expanders;
+    writer.fd = out_fd;
+    writer.failed = 0;
+    pthread_create( &(writer.thread), NULL, write_batches, &writer );
+
+    status = read_batches( in_fd, expanders, n_expanders );
+
+    for ( i = 0; i < n_expanders; i++ ) {
+        pthread_join( expanders[i].thread, NULL );
+        failed += expanders[i].failed;
+    }
+    pthread_join( writer.thread, NULL );
+
+    for ( i = 0; i < n_expanders; i++ ) {
+        free_ring( expanders[i].input );
+        free_ring( expanders[i].output );
+    }
+    free( expanders );
+
+    return (status != 0) || writer.failed || (failed > 0);
+}
@@ -0,0 +1,40 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BATCH_SUPPORT_H__
+#define __BATCH_SUPPORT_H__
+
+#include "alias_support.h"
+
+/* Batch mode reads commands, one per line, and writes each command
+   with its aliases expanded, one per line and in the same order.
+
+   For very large inputs the work is done by a pipeline of threads, so
+   that reading, expanding and writing all overlap. A reader thread
+   reads large blocks and cuts them into batches of complete lines,
+   which it hands out in turn to the expander threads. Each expander
+   expands the commands in its batches, and the writer collects the
+   batches from the expanders in the same turn order, so the output
+   stays in order. Each stage hands batches to the next through a
+   bounded ring (see ring_support.h), so a slow stage holds up the
+   ones before it rather than using more and more memory. */
+
+int run_batch( int in_fd, int out_fd, AliasTable *aliases, int n_expanders );
+
+
+#endif /* __BATCH_SUPPORT_H__ */
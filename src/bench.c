@@ -0,0 +1,413 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark driver for the alias table. Loads an alias table,
+   optionally padded out with synthetic aliases, and compares the
+   memory used by, and lookup and expansion latency of, the different
+   ways of finding an alias. Where the hardware counters can be read,
+   it also reports the cycles, instructions, cache misses and branch
+   misses of loading the table and of each kind of lookup and
+   expansion.
+
+       bench <alias-file> [number-of-synthetic-aliases]
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "list_support.h"
+#include "string_support.h"
+#include "alias_support.h"
+#include "dafsa_support.h"
+#include "dealias_support.h"
+#include "allocator_support.h"
+
+/* Each way of looking up an alias is run over all the probe words
+   repeatedly, until at least this many seconds have passed. */
+
+#define MIN_SECONDS 0.25
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The hardware counters, each opened separately with
+   perf_event_open(), so that any which can't be counted, as in many
+   virtual machines and containers, can simply be left out. The kernel
+   shares the hardware between more events than it can count at once
+   by taking turns, so each count is scaled up by the share of the time
+   for which it was counted. */
+
+#define N_COUNTERS 5
+
+#define L1D_READ_MISSES (PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    const char *name;
+    unsigned int type;
+    unsigned long long config;
+} counter_events[N_COUNTERS] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1d-misses", PERF_TYPE_HW_CACHE, L1D_READ_MISSES },
+    { "LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "br-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+#define CYCLES 0
+#define INSTRUCTIONS 1
+
+static int counter_fds[N_COUNTERS];
+static int n_open_counters = 0;
+
+/* Open the counters for this thread, in user space only. Returns the
+   number which could be opened, and if none could, sets errno. */
+
+static int open_counters( void )
+{
+    struct perf_event_attr attr;
+    int error = 0;
+    int i;
+
+    for ( i = 0; i < N_COUNTERS; i++ ) {
+        memset( &attr, 0, sizeof(attr) );
+        attr.size = sizeof(attr);
+        attr.type = counter_events[i].type;
+        attr.config = counter_events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counter_fds[i] = syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+        if ( counter_fds[i] >= 0 ) {
+            n_open_counters++;
+        } else if ( error == 0 ) {
+            error = errno;
+        }
+    }
+
+    if ( n_open_counters == 0 ) {
+        errno = error;
+    }
+
+    return n_open_counters;
+}
+
+static void start_counters( void )
+{
+    int i;
+
+    for ( i = 0; i < N_COUNTERS; i++ ) {
+        if ( counter_fds[i] >= 0 ) {
+            ioctl( counter_fds[i], PERF_EVENT_IOC_RESET, 0 );
+            ioctl( counter_fds[i], PERF_EVENT_IOC_ENABLE, 0 );
+        }
+    }
+}
+
+/* Stop the counters, and set each count, divided by the number of
+   operations counted, or to -1 if it couldn't be counted. */
+
+static void stop_counters( double *counts, long n_operations )
+{
+    unsigned long long values[3];
+    int i;
+
+    for ( i = 0; i < N_COUNTERS; i++ ) {
+        counts[i] = -1;
+        if ( counter_fds[i] >= 0 ) {
+            ioctl( counter_fds[i], PERF_EVENT_IOC_DISABLE, 0 );
+            if ( (read( counter_fds[i], values, sizeof(values) ) == sizeof(values)) &&
+                 (values[2] > 0) ) {
+                counts[i] = (double) values[0] * values[1] / values[2] / n_operations;
+            }
+        }
+    }
+}
+
+static void print_counters( const char *name, const double *counts )
+{
+    int i;
+
+    printf( "%-14s", name );
+    for ( i = 0; i < N_COUNTERS; i++ ) {
+        if ( counts[i] < 0 ) {
+            printf( " %12s", "-" );
+        } else {
+            printf( " %12.1f", counts[i] );
+        }
+        if ( i == INSTRUCTIONS ) {
+            if ( (counts[CYCLES] > 0) && (counts[INSTRUCTIONS] >= 0) ) {
+                printf( " %6.2f", counts[INSTRUCTIONS] / counts[CYCLES] );
+            } else {
+                printf( " %6s", "-" );
+            }
+        }
+    }
+    printf( "\n" );
+}
+
+/* Names for the synthetic aliases. These share prefixes in much the
+   same way as real alias names do. */
+
+static char *synthetic_name( int i )
+{
+    static const char *prefixes[] = { "l", "ls", "git", "make", "cd", "run" };
+    char buffer[64];
+
+    snprintf( buffer, sizeof(buffer), "%s%d", prefixes[i % 6], i / 6 );
+    return strdup( buffer );
+}
+
+/* The lookup we have without any index: compare the word with every
+   alias in turn, checking the hashes first. */
+
+static int scan_lookup( AliasTable *table, const char *word, size_t length )
+{
+    struct dafsa *index = table->index;
+    int result;
+
+    table->index = NULL;
+    result = find_alias( table, word, length );
+    table->index = index;
+
+    return result;
+}
+
+static int dafsa_index_lookup( AliasTable *table, const char *word, size_t length )
+{
+    return dafsa_lookup( table->index, word, length );
+}
+
+typedef int (*LookupFunction)( AliasTable *table, const char *word, size_t length );
+
+/* Returns the average time for a single lookup, in nanoseconds, the
+   number of probe words found in "found", and the counts for a single
+   lookup in "counts". */
+
+static double time_lookups( LookupFunction lookup, AliasTable *table,
+                            char **probes, size_t *lengths, int n_probes, int *found,
+                            double *counts )
+{
+    double start = now();
+    double elapsed;
+    long n_lookups = 0;
+    int i;
+
+    start_counters();
+    do {
+        *found = 0;
+        for ( i = 0; i < n_probes; i++ ) {
+            *found += (lookup( table, probes[i], lengths[i] ) != NO_ALIAS);
+        }
+        n_lookups += n_probes;
+        elapsed = now() - start;
+    } while ( elapsed < MIN_SECONDS );
+    stop_counters( counts, n_lookups );
+
+    return elapsed * 1e9 / n_lookups;
+}
+
+/* As above, but expanding each of the commands in turn with
+   dealias_command(), with or without the automaton. A single pass over
+   the commands with a slow lookup may take much longer than
+   MIN_SECONDS, so the time is checked every few commands. */
+
+static double time_dealias( AliasTable *table, int use_index, char **commands, int n_commands,
+                            double *counts )
+{
+    struct dafsa *index = table->index;
+    double start;
+    double elapsed;
+    long n_expanded = 0;
+
+    if ( !use_index ) {
+        table->index = NULL;
+    }
+
+    start = now();
+    start_counters();
+    do {
+        deallocate( dealias_command( commands[n_expanded % n_commands], table ) );
+        n_expanded++;
+        elapsed = ((n_expanded % 16) == 0) ? now() - start : 0;
+    } while ( elapsed < MIN_SECONDS );
+    stop_counters( counts, n_expanded );
+
+    table->index = index;
+
+    return elapsed * 1e9 / n_expanded;
+}
+
+int main( int argc, char *argv[] )
+{
+    AliasTable *table;
+    char **probes;
+    char **commands;
+    char *name;
+    size_t *lengths;
+    int n_probes;
+    int n_synthetic = 0;
+    int scan_found;
+    int dafsa_found;
+    int i;
+    double start;
+    double scan_time;
+    double dafsa_time;
+    double scan_dealias_time;
+    double dafsa_dealias_time;
+    double load_counts[N_COUNTERS];
+    double scan_counts[N_COUNTERS];
+    double dafsa_counts[N_COUNTERS];
+    double scan_dealias_counts[N_COUNTERS];
+    double dafsa_dealias_counts[N_COUNTERS];
+    int counter_error = 0;
+    size_t table_bytes;
+    size_t list_bytes;
+    size_t dafsa_bytes;
+
+    if ( argc < 2 ) {
+        fprintf( stderr, "usage: %s <alias-file> [number-of-synthetic-aliases]\n", argv[0] );
+        return 1;
+    }
+
+    if ( argc > 2 ) {
+        n_synthetic = atoi( argv[2] );
+    }
+
+    if ( open_counters() == 0 ) {
+        counter_error = errno;
+    }
+
+    start = now();
+    start_counters();
+    table = read_alias_table( argv[1] );
+    for ( i = 0; i < n_synthetic; i++ ) {
+        name = synthetic_name( i );
+        add_alias( table, name, strlen( name ), "echo !*", 7 );
+        free( name );
+    }
+    build_alias_index( table );
+    stop_counters( load_counts, 1 );
+    printf( "Loaded %d aliases in %.3f ms\n", table->n_aliases, (now() - start) * 1e3 );
+
+    /* Probe with every alias name, which will be found, and the same
+       number of words which won't. */
+
+    probes = malloc( 2 * table->n_aliases * sizeof(char *) );
+    lengths = malloc( 2 * table->n_aliases * sizeof(size_t) );
+    n_probes = 0;
+    for ( i = 0; i < table->n_aliases; i++ ) {
+        probes[n_probes++] = strdup( alias_name( table, i ) );
+        probes[n_probes++] = append_dup_string( copy_string( alias_name( table, i ) ), "_" );
+    }
+    for ( i = 0; i < n_probes; i++ ) {
+        lengths[i] = strlen( probes[i] );
+    }
+
+    scan_time = time_lookups( scan_lookup, table, probes, lengths, n_probes, &scan_found,
+                              scan_counts );
+    dafsa_time = time_lookups( dafsa_index_lookup, table, probes, lengths, n_probes,
+                               &dafsa_found, dafsa_counts );
+
+    if ( scan_found != dafsa_found ) {
+        fprintf( stderr, "The scan and the automaton disagree!\n" );
+        return 1;
+    }
+
+    /* Memory for the aliases themselves, as they are stored now and
+       as they were when each one was a separately allocated list node
+       with separately allocated strings. */
+
+    table_bytes = alias_table_size( table );
+    list_bytes = alias_list_size( table );
+
+    printf( "\n%-10s %12s %14s\n", "table", "bytes", "bytes/alias" );
+    printf( "%-10s %12zu %14.1f\n", "pool", table_bytes,
+            (double) table_bytes / table->n_aliases );
+    printf( "%-10s %12zu %14.1f\n", "list", list_bytes,
+            (double) list_bytes / table->n_aliases );
+
+    /* Memory needed, on top of the table, to find an alias. The scan
+       only uses the table's own arrays. */
+
+    dafsa_bytes = dafsa_size( table->index );
+
+    printf( "\n%-10s %12s %14s %16s\n", "index", "bytes", "bytes/alias", "ns/lookup" );
+    printf( "%-10s %12d %14.1f %16.1f\n", "scan", 0, 0.0, scan_time );
+    printf( "%-10s %12zu %14.1f %16.1f\n", "dafsa", dafsa_bytes,
+            (double) dafsa_bytes / table->n_aliases,
+            dafsa_time );
+
+    if ( table->index != NULL ) {
+        printf( "\nThe automaton has %d states and %d edges for %d names\n",
+                table->index->n_nodes, table->index->n_edges, table->index->n_words );
+    }
+
+    /* Expand a command starting with each of the probe words, half of
+       which are aliases. */
+
+    commands = malloc( n_probes * sizeof(char *) );
+    for ( i = 0; i < n_probes; i++ ) {
+        commands[i] = append_dup_string( copy_string( probes[i] ), " one two" );
+    }
+
+    scan_dealias_time = time_dealias( table, 0, commands, n_probes, scan_dealias_counts );
+    dafsa_dealias_time = time_dealias( table, 1, commands, n_probes, dafsa_dealias_counts );
+
+    printf( "\n%-10s %16s\n", "dealias", "ns/command" );
+    printf( "%-10s %16.1f\n", "scan", scan_dealias_time );
+    printf( "%-10s %16.1f\n", "dafsa", dafsa_dealias_time );
+
+    /* The counts for loading the table are for the whole load, and
+       the others for a single lookup or command. */
+
+    if ( counter_error != 0 ) {
+        printf( "\nHardware counters unavailable: %s\n", strerror( counter_error ) );
+    } else {
+        printf( "\n%-14s", "counters" );
+        for ( i = 0; i < N_COUNTERS; i++ ) {
+            printf( " %12s", counter_events[i].name );
+            if ( i == INSTRUCTIONS ) {
+                printf( " %6s", "IPC" );
+            }
+        }
+        printf( "\n" );
+        print_counters( "load", load_counts );
+        print_counters( "scan", scan_counts );
+        print_counters( "dafsa", dafsa_counts );
+        print_counters( "dealias-scan", scan_dealias_counts );
+        print_counters( "dealias-dafsa", dafsa_dealias_counts );
+    }
+
+    return 0;
+}
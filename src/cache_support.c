@@ -0,0 +1,400 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "alias_support.h"
+#include "dealias_support.h"
+#include "cache_support.h"
+
+/* The most alias files that the cache remembers. Every file that a
+   client names has an entry, even if it uses a table which is
+   already there. */
+
+#define MAX_ENTRIES 10000
+
+/* Create a cache which will hold up to max_size bytes of tables. */
+
+TableCache *new_table_cache( size_t max_size )
+{
+    TableCache *cache = calloc( 1, sizeof(TableCache) );
+
+    if ( cache != NULL ) {
+        pthread_mutex_init( &(cache->lock), NULL );
+        cache->max_size = max_size;
+    }
+
+    return cache;
+}
+
+/* Read the whole of an open file into memory. Returns NULL if the
+   file can't be read. */
+
+static char *read_file( int fd, size_t *length )
+{
+    char *contents = NULL;
+    size_t size = 0;
+    ssize_t n;
+
+    *length = 0;
+
+    do {
+        if ( *length == size ) {
+            size = 2 * size + 4096;
+            contents = realloc( contents, size );
+        }
+        n = read( fd, &(contents[*length]), size - *length );
+        if ( n > 0 ) {
+            *length += n;
+        }
+    } while ( n > 0 );
+
+    if ( n < 0 ) {
+        free( contents );
+        return NULL;
+    }
+
+    return contents;
+}
+
+/* A 64 bit FNV-1a hash of the contents of a file. */
+
+static unsigned long long hash_contents( char *contents, size_t length )
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i;
+
+    for ( i = 0; i < length; i++ ) {
+        hash ^= (unsigned char) contents[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/* Build an alias table from the contents of an alias file. */
+
+static AliasTable *parse_contents( char *contents, size_t length )
+{
+    AliasTable *table;
+
+    if ( length > 0 ) {
+        table = read_alias_text( contents, length );
+    } else {
+        table = new_alias_table();
+    }
+
+    return table;
+}
+
+static CacheEntry *find_entry( TableCache *cache, char *path )
+{
+    CacheEntry *entry = cache->entries;
+
+    while ( (entry != NULL) && (strcmp( entry->path, path ) != 0) ) {
+        entry = entry->next;
+    }
+
+    return entry;
+}
+
+static SharedTable *find_shared_table( TableCache *cache, unsigned long long hash,
+                                       char *contents, size_t length )
+{
+    SharedTable *shared = cache->tables;
+
+    while ( (shared != NULL) &&
+            ((shared->content_hash != hash) || (shared->content_length != length) ||
+             (memcmp( shared->contents, contents, length ) != 0)) ) {
+        shared = shared->next;
+    }
+
+    return shared;
+}
+
+/* Has the file changed since the entry was made? */
+
+static int same_file( CacheEntry *entry, struct stat *st )
+{
+    return (entry->device == st->st_dev) &&
+        (entry->inode == st->st_ino) &&
+        (entry->file_size == st->st_size) &&
+        (entry->mtime.tv_sec == st->st_mtim.tv_sec) &&
+        (entry->mtime.tv_nsec == st->st_mtim.tv_nsec);
+}
+
+/* Throw away a table, along with all the entries which use it. */
+
+static void evict( TableCache *cache, SharedTable *victim )
+{
+    CacheEntry **entry = &(cache->entries);
+    CacheEntry *e;
+    SharedTable **shared = &(cache->tables);
+
+    while ( *entry != NULL ) {
+        e = *entry;
+        if ( e->shared == victim ) {
+            *entry = e->next;
+            free( e->path );
+            free( e );
+            cache->n_entries--;
+        } else {
+            entry = &(e->next);
+        }
+    }
+
+    while ( *shared != victim ) {
+        shared = &((*shared)->next);
+    }
+    *shared = victim->next;
+
+    cache->size -= victim->size;
+    cache->evictions++;
+    cache->generation++;
+
+    free_alias_table( victim->table );
+    free( victim->contents );
+    free( victim );
+}
+
+/* Forget the least recently used alias file. Its table is left to be
+   thrown away along with the others when the cache is too big. */
+
+static void forget_oldest_entry( TableCache *cache )
+{
+    CacheEntry **entry;
+    CacheEntry **oldest = NULL;
+    CacheEntry *e;
+
+    for ( entry = &(cache->entries); *entry != NULL; entry = &((*entry)->next) ) {
+        if ( (oldest == NULL) || ((*entry)->last_used < (*oldest)->last_used) ) {
+            oldest = entry;
+        }
+    }
+
+    if ( oldest != NULL ) {
+        e = *oldest;
+        *oldest = e->next;
+        free( e->path );
+        free( e );
+        cache->n_entries--;
+    }
+}
+
+/* Throw away the least recently used tables until the cache is within
+   its limit, but never a table which is in use. */
+
+static void evict_tables( TableCache *cache )
+{
+    SharedTable *shared;
+    SharedTable *oldest;
+
+    while ( cache->size > cache->max_size ) {
+        oldest = NULL;
+        for ( shared = cache->tables; shared != NULL; shared = shared->next ) {
+            if ( (shared->users == 0) &&
+                 ((oldest == NULL) || (shared->last_used < oldest->last_used)) ) {
+                oldest = shared;
+            }
+        }
+
+        if ( oldest == NULL ) {
+            break;
+        }
+
+        evict( cache, oldest );
+    }
+}
+
+/* Return the alias table for an alias file, loading it if we haven't
+   seen the file before or it has changed. Returns NULL if the file
+   can't be read. The table belongs to the cache, and must be handed
+   back with release_alias_table() once the caller has finished with
+   it.
+
+   Loading a table is done with the cache locked. That holds up other
+   threads, but only the first time that anyone asks for a file.
+
+   The file is opened even when we already have its table, so that
+   only a caller who can read the file gets it: the server relies on
+   this, opening the file as its client. */
+
+static AliasTable *get_table_locked( TableCache *cache, char *path )
+{
+    struct stat st;
+    CacheEntry *entry;
+    SharedTable *shared;
+    char *contents;
+    size_t length;
+    unsigned long long hash;
+    int fd;
+
+    cache->requests++;
+    cache->clock++;
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) {
+        return NULL;
+    }
+
+    if ( fstat( fd, &st ) != 0 ) {
+        close( fd );
+        return NULL;
+    }
+
+    entry = find_entry( cache, path );
+    if ( (entry != NULL) && same_file( entry, &st ) ) {
+        close( fd );
+        cache->hits++;
+        entry->last_used = cache->clock;
+        entry->shared->last_used = cache->clock;
+        entry->shared->users++;
+        return entry->shared->table;
+    }
+
+    /* Either we haven't seen this file before, or it has changed. If
+       someone else has an identical file, we can use their table. */
+
+    contents = read_file( fd, &length );
+    close( fd );
+    if ( contents == NULL ) {
+        return NULL;
+    }
+
+    hash = hash_contents( contents, length );
+    shared = find_shared_table( cache, hash, contents, length );
+
+    if ( shared != NULL ) {
+        cache->shared_hits++;
+        free( contents );
+    } else {
+        shared = calloc( 1, sizeof(SharedTable) );
+        shared->content_hash = hash;
+        shared->contents = contents;
+        shared->content_length = length;
+        shared->table = parse_contents( contents, length );
+        shared->size = sizeof(SharedTable) + length + alias_table_size( shared->table ) +
+            alias_index_size( shared->table );
+        shared->next = cache->tables;
+        cache->tables = shared;
+        cache->size += shared->size;
+        cache->loads++;
+    }
+
+    if ( entry == NULL ) {
+        if ( cache->n_entries >= MAX_ENTRIES ) {
+            forget_oldest_entry( cache );
+        }
+
+        entry = calloc( 1, sizeof(CacheEntry) );
+        entry->path = strdup( path );
+        entry->next = cache->entries;
+        cache->entries = entry;
+        cache->n_entries++;
+    }
+
+    entry->device = st.st_dev;
+    entry->inode = st.st_ino;
+    entry->file_size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->shared = shared;
+    entry->last_used = cache->clock;
+    cache->generation++;
+
+    shared->last_used = cache->clock;
+    shared->users++;
+
+    evict_tables( cache );
+
+    return shared->table;
+}
+
+AliasTable *get_alias_table( TableCache *cache, char *path )
+{
+    AliasTable *table;
+
+    pthread_mutex_lock( &(cache->lock) );
+    table = get_table_locked( cache, path );
+    pthread_mutex_unlock( &(cache->lock) );
+
+    return table;
+}
+
+/* Hand back a table returned by get_alias_table(). */
+
+void release_alias_table( TableCache *cache, AliasTable *table )
+{
+    SharedTable *shared;
+
+    if ( table == NULL ) {
+        return;
+    }
+
+    pthread_mutex_lock( &(cache->lock) );
+
+    for ( shared = cache->tables; shared != NULL; shared = shared->next ) {
+        if ( shared->table == table ) {
+            shared->users--;
+            break;
+        }
+    }
+
+    evict_tables( cache );
+
+    pthread_mutex_unlock( &(cache->lock) );
+}
+
+/* Print statistics about the cache. */
+
+void print_cache_stats( TableCache *cache, FILE *f )
+{
+    CacheEntry *entry;
+    SharedTable *shared;
+    int n_entries = 0;
+    int n_tables = 0;
+
+    pthread_mutex_lock( &(cache->lock) );
+
+    for ( entry = cache->entries; entry != NULL; entry = entry->next ) {
+        n_entries++;
+    }
+
+    for ( shared = cache->tables; shared != NULL; shared = shared->next ) {
+        n_tables++;
+    }
+
+    fprintf( f, "Alias files: %d\n", n_entries );
+    fprintf( f, "Tables: %d\n", n_tables );
+    fprintf( f, "Cache memory: %zu of %zu bytes\n", cache->size, cache->max_size );
+    fprintf( f, "Requests: %lu\n", cache->requests );
+    fprintf( f, "Cache hits: %lu (%.1f%%)\n", cache->hits,
+             (cache->requests > 0) ? (100.0 * cache->hits / cache->requests) : 0.0 );
+    fprintf( f, "Shared table hits: %lu\n", cache->shared_hits );
+    fprintf( f, "Tables loaded: %lu\n", cache->loads );
+    fprintf( f, "Tables evicted: %lu\n", cache->evictions );
+    fprintf( f, "Table generation: %lu\n", cache->generation );
+
+    pthread_mutex_unlock( &(cache->lock) );
+}
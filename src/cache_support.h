@@ -0,0 +1,98 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CACHE_SUPPORT_H__
+#define __CACHE_SUPPORT_H__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "alias_support.h"
+
+/* A server may be asked to expand commands using the alias tables of
+   many different users. The cache keeps the tables that it has loaded,
+   so that each one is only read once.
+
+   Each alias file that we have been asked about has an entry, which
+   remembers the file's inode and modification time so that we notice
+   when it changes. Many users have exactly the same aliases, so
+   entries point to tables which are shared between all the files with
+   the same contents. When the tables take up more than the cache's
+   memory limit, the least recently used tables are thrown away, and
+   when there are too many entries, the least recently used entries.
+
+   A table keeps the contents of the file it was made from, so that it
+   is only shared with a file whose contents are the same, rather than
+   one which just has the same hash. */
+
+typedef struct shared_table {
+    struct shared_table *next;
+    unsigned long long content_hash;
+    char *contents;
+    size_t content_length;
+    AliasTable *table;
+    size_t size;
+    unsigned long last_used;
+    int users;
+} SharedTable;
+
+typedef struct cache_entry {
+    struct cache_entry *next;
+    char *path;
+    dev_t device;
+    ino_t inode;
+    struct timespec mtime;
+    off_t file_size;
+    SharedTable *shared;
+    unsigned long last_used;
+} CacheEntry;
+
+typedef struct table_cache {
+    pthread_mutex_t lock;
+    CacheEntry *entries;
+    int n_entries;
+    SharedTable *tables;
+    size_t max_size;
+    size_t size;
+    unsigned long clock;
+
+    /* Counters reported by print_cache_stats(). */
+    unsigned long requests;
+    unsigned long hits;
+    unsigned long shared_hits;
+    unsigned long loads;
+    unsigned long evictions;
+
+    /* Goes up whenever a file is given a different table, or a table
+       is thrown away. */
+    unsigned long generation;
+} TableCache;
+
+TableCache *new_table_cache( size_t max_size );
+
+AliasTable *get_alias_table( TableCache *cache, char *path );
+
+void release_alias_table( TableCache *cache, AliasTable *table );
+
+void print_cache_stats( TableCache *cache, FILE *f );
+
+
+#endif /* __CACHE_SUPPORT_H__ */
@@ -0,0 +1,239 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <poll.h>
+
+#include "server_support.h"
+#include "client_support.h"
+#include "allocator_support.h"
+
+#define READ_SIZE 65536
+
+static void queue_bytes( ExpansionClient *client, const void *data, size_t length )
+{
+    if ( length == 0 ) {
+        return;
+    }
+
+    if ( client->out_used + length > client->out_size ) {
+        client->out_size = 2 * client->out_size + length;
+        client->out = realloc( client->out, client->out_size );
+    }
+
+    memcpy( &(client->out[client->out_used]), data, length );
+    client->out_used += length;
+}
+
+/* Connect to a server, and queue the bytes which tell it that we're
+   using the binary protocol. Returns NULL if we can't connect. */
+
+ExpansionClient *open_expansion_client( char *address )
+{
+    ExpansionClient *client;
+    int fd;
+
+    fd = connect_to_server( address );
+    if ( fd < 0 ) {
+        return NULL;
+    }
+
+    client = calloc( 1, sizeof(ExpansionClient) );
+    client->fd = fd;
+    queue_bytes( client, BINARY_MAGIC, BINARY_MAGIC_LENGTH );
+
+    return client;
+}
+
+/* Queue a request to expand length bytes of command, using no aliases
+   at all if alias_file is NULL, and any of the REQUEST_ARGV and
+   REQUEST_NUL_WORDS flags. Returns the id of the request. */
+
+unsigned int queue_expansion( ExpansionClient *client, char *alias_file,
+                              char *command, size_t length, int flags )
+{
+    unsigned char header[FRAME_HEADER_SIZE];
+    FrameHeader frame;
+
+    frame.id = client->next_id++;
+    frame.flags = flags | ((alias_file == NULL) ? REQUEST_NOALIAS : 0);
+    frame.path_length = (alias_file == NULL) ? 0 : strlen( alias_file );
+    frame.length = length;
+
+    encode_frame_header( header, &frame );
+    queue_bytes( client, header, FRAME_HEADER_SIZE );
+    queue_bytes( client, alias_file, frame.path_length );
+    queue_bytes( client, command, frame.length );
+
+    return frame.id;
+}
+
+/* Read whatever the server has sent. Returns -1 if the connection has
+   been closed, or on an error. */
+
+static int read_responses( ExpansionClient *client )
+{
+    ssize_t n;
+
+    if ( client->in_start > 0 ) {
+        client->in_used -= client->in_start;
+        memmove( client->in, &(client->in[client->in_start]), client->in_used );
+        client->in_start = 0;
+    }
+
+    if ( client->in_used + READ_SIZE > client->in_size ) {
+        client->in_size = client->in_used + READ_SIZE;
+        client->in = realloc( client->in, client->in_size );
+    }
+
+    do {
+        n = read( client->fd, &(client->in[client->in_used]), READ_SIZE );
+    } while ( (n < 0) && (errno == EINTR) );
+
+    if ( n <= 0 ) {
+        return -1;
+    }
+
+    client->in_used += n;
+    return 0;
+}
+
+/* Send all the queued requests. The server stops reading from a
+   client which isn't reading its responses, so while we wait to write
+   we read any responses which are waiting, and keep them for
+   receive_expansion(). Returns -1 on an error. */
+
+int send_expansions( ExpansionClient *client )
+{
+    struct pollfd fds;
+    size_t sent = 0;
+    ssize_t n;
+
+    fds.fd = client->fd;
+    fds.events = POLLIN | POLLOUT;
+
+    while ( sent < client->out_used ) {
+        if ( poll( &fds, 1, -1 ) < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+
+        if ( (fds.revents & POLLIN) && (read_responses( client ) < 0) ) {
+            return -1;
+        }
+
+        if ( fds.revents & POLLOUT ) {
+            n = write( client->fd, &(client->out[sent]), client->out_used - sent );
+            if ( n > 0 ) {
+                sent += n;
+            } else if ( (n < 0) && (errno != EINTR) && (errno != EAGAIN) ) {
+                return -1;
+            }
+        } else if ( fds.revents & (POLLERR | POLLHUP) ) {
+            return -1;
+        }
+    }
+
+    client->out_used = 0;
+    return 0;
+}
+
+/* Wait for the next response. On success returns zero, and sets the
+   id of the request it belongs to, the expanded command or error
+   message, which the caller should deallocate(), its length, and
+   whether it is an error. Returns -1 if the connection fails. */
+
+int receive_expansion( ExpansionClient *client, unsigned int *id, char **result,
+                       size_t *length, int *is_error )
+{
+    FrameHeader frame;
+
+    for ( ;; ) {
+        if ( client->in_used - client->in_start >= FRAME_HEADER_SIZE ) {
+            decode_frame_header( &(client->in[client->in_start]), &frame );
+
+            if ( client->in_used - client->in_start >= FRAME_HEADER_SIZE + frame.length ) {
+                *id = frame.id;
+                *is_error = (frame.flags & RESPONSE_ERROR) != 0;
+                *result = allocate( frame.length + 1 );
+                memcpy( *result, &(client->in[client->in_start + FRAME_HEADER_SIZE]),
+                        frame.length );
+                (*result)[frame.length] = '\0';
+                *length = frame.length;
+                client->in_start += FRAME_HEADER_SIZE + frame.length;
+                return 0;
+            }
+        }
+
+        if ( read_responses( client ) < 0 ) {
+            return -1;
+        }
+    }
+}
+
+void close_expansion_client( ExpansionClient *client )
+{
+    close( client->fd );
+    free( client->out );
+    free( client->in );
+    free( client );
+}
+
+/* Ask a server to expand a single command, as for queue_expansion(),
+   using no aliases if alias_file is "-noalias". Returns the expanded
+   command, with its length in *result_length, or NULL if the server
+   couldn't be reached or reported an error, in which case we print a
+   warning. */
+
+char *request_expansion( char *address, char *alias_file, char *command,
+                         size_t length, int flags, size_t *result_length )
+{
+    ExpansionClient *client;
+    unsigned int id;
+    char *result = NULL;
+    int is_error;
+
+    client = open_expansion_client( address );
+    if ( client == NULL ) {
+        return NULL;
+    }
+
+    queue_expansion( client, (strcmp( alias_file, "-noalias" ) == 0) ? NULL : alias_file,
+                     command, length, flags );
+
+    if ( (send_expansions( client ) < 0) ||
+         (receive_expansion( client, &id, &result, result_length, &is_error ) < 0) ) {
+        warnx( "No response from server" );
+    } else if ( is_error ) {
+        warnx( "%s", result );
+        deallocate( result );
+        result = NULL;
+    }
+
+    close_expansion_client( client );
+
+    return result;
+}
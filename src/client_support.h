@@ -0,0 +1,58 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CLIENT_SUPPORT_H__
+#define __CLIENT_SUPPORT_H__
+
+#include <stddef.h>
+
+/* A client for the binary protocol described in server_support.h.
+   Requests are queued with queue_expansion(), which returns the id
+   of the request, and sent with send_expansions(). Any number of
+   requests can be outstanding at once, and receive_expansion() returns
+   the responses in whatever order they arrive. */
+
+typedef struct expansion_client {
+    int fd;
+    unsigned int next_id;
+    unsigned char *out;
+    size_t out_used;
+    size_t out_size;
+    unsigned char *in;
+    size_t in_start;
+    size_t in_used;
+    size_t in_size;
+} ExpansionClient;
+
+ExpansionClient *open_expansion_client( char *address );
+
+unsigned int queue_expansion( ExpansionClient *client, char *alias_file,
+                              char *command, size_t length, int flags );
+
+int send_expansions( ExpansionClient *client );
+
+int receive_expansion( ExpansionClient *client, unsigned int *id, char **result,
+                       size_t *length, int *is_error );
+
+void close_expansion_client( ExpansionClient *client );
+
+char *request_expansion( char *address, char *alias_file, char *command,
+                         size_t length, int flags, size_t *result_length );
+
+
+#endif /* __CLIENT_SUPPORT_H__ */
@@ -0,0 +1,378 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Build a minimal acyclic automaton over the names in an alias list,
+   and look words up in it. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alias_support.h"
+#include "dafsa_support.h"
+#include "allocator_support.h"
+
+/* While we are building the automaton, each state is a separately
+   allocated node. Once the states have been merged these are copied
+   into the flat arrays of the Dafsa, and freed. */
+
+typedef struct trie_node {
+    struct trie_node **children;
+    unsigned char *labels;
+    int n_children;
+    int final;
+    int id;
+    unsigned int hash;
+} TrieNode;
+
+/* The register holds one representative of every distinct state we
+   have seen so far, in a simple open addressed hash table. States
+   are registered children first, so "order" lists them in an order
+   in which every state comes after all of its children. */
+
+typedef struct state_register {
+    TrieNode **slots;
+    unsigned int mask;
+    TrieNode **order;
+    int n_states;
+} StateRegister;
+
+/* We sort pointers to the names in the pool, and afterwards work out
+   which alias each one belongs to from where it is in the pool. */
+
+static int compare_names( const void *a, const void *b )
+{
+    const char *x = *(const char **) a;
+    const char *y = *(const char **) b;
+    int result = strcmp( x, y );
+
+    /* Put later definitions of the same name first. Names appear in
+       the pool in the order in which they were defined. */
+
+    if ( result == 0 ) {
+        result = (x < y) - (x > y);
+    }
+
+    return result;
+}
+
+/* Names are added to the pool in the order in which the aliases are
+   defined, so a binary search of the offsets finds the alias. */
+
+static int alias_at( AliasTable *table, const char *name )
+{
+    unsigned int offset = name - table->pool;
+    int low = 0;
+    int high = table->n_aliases - 1;
+    int middle;
+
+    while ( low < high ) {
+        middle = (low + high) / 2;
+        if ( table->lhs_offset[middle] < offset ) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static TrieNode *new_trie_node( void )
+{
+    return allocate_zeroed( 1, sizeof(TrieNode) );
+}
+
+static void free_trie_node( TrieNode *node )
+{
+    deallocate( node->children );
+    deallocate( node->labels );
+    deallocate( node );
+}
+
+/* Insert a word into the trie. The words must be inserted in sorted
+   order, so that a new edge always has the largest label of any edge
+   leaving its state, and the edges stay sorted. */
+
+static int insert_word( TrieNode *root, const char *word )
+{
+    TrieNode *node = root;
+    TrieNode *child;
+    unsigned char c;
+    int n_new = 0;
+
+    for ( ; *word != '\0'; word++ ) {
+        c = (unsigned char) *word;
+
+        if ( (node->n_children > 0) && (node->labels[node->n_children-1] == c) ) {
+            node = node->children[node->n_children-1];
+        } else {
+            child = new_trie_node();
+            node->children = reallocate( node->children,
+                                      (node->n_children + 1) * sizeof(TrieNode *) );
+            node->labels = reallocate( node->labels, node->n_children + 1 );
+            node->children[node->n_children] = child;
+            node->labels[node->n_children] = c;
+            node->n_children++;
+            node = child;
+            n_new++;
+        }
+    }
+
+    node->final = 1;
+
+    return n_new;
+}
+
+/* Two states are equivalent if they are both final or both not, and
+   have the same edges leading to the same (already merged) states. A
+   leaf has no edges, and no arrays of them to compare. */
+
+static int equivalent( TrieNode *a, TrieNode *b )
+{
+    return (a->hash == b->hash) &&
+        (a->final == b->final) &&
+        (a->n_children == b->n_children) &&
+        ((a->n_children == 0) ||
+         ((memcmp( a->labels, b->labels, a->n_children ) == 0) &&
+          (memcmp( a->children, b->children, a->n_children * sizeof(TrieNode *) ) == 0)));
+}
+
+static unsigned int hash_state( TrieNode *node )
+{
+    unsigned int hash = 2166136261u ^ node->final;
+    int i;
+
+    for ( i = 0; i < node->n_children; i++ ) {
+        hash = (hash ^ node->labels[i]) * 16777619u;
+        hash = (hash ^ (unsigned int) node->children[i]->id) * 16777619u;
+    }
+
+    return hash;
+}
+
+/* Merge a sub-trie, bottom up, into the states already in the
+   register. Returns the registered state equivalent to "node", which
+   is freed if an equivalent state already existed. */
+
+static TrieNode *minimise( TrieNode *node, StateRegister *reg )
+{
+    unsigned int slot;
+    int i;
+
+    for ( i = 0; i < node->n_children; i++ ) {
+        node->children[i] = minimise( node->children[i], reg );
+    }
+
+    node->hash = hash_state( node );
+
+    for ( slot = node->hash & reg->mask; reg->slots[slot] != NULL;
+          slot = (slot + 1) & reg->mask ) {
+        if ( equivalent( node, reg->slots[slot] ) ) {
+            free_trie_node( node );
+            return reg->slots[slot];
+        }
+    }
+
+    node->id = reg->n_states;
+    reg->slots[slot] = node;
+    reg->order[reg->n_states++] = node;
+
+    return node;
+}
+
+/* Build the automaton for all the names in an alias table. If the
+   same name has been defined more than once, the last definition
+   wins, which matches find_alias(). Returns NULL if there are no
+   aliases. */
+
+Dafsa *build_dafsa( AliasTable *table )
+{
+    Dafsa *dafsa;
+    char **names;
+    TrieNode *root;
+    StateRegister reg;
+    int n_aliases = table->n_aliases;
+    int n_names;
+    int n_trie_nodes = 1;
+    int i;
+    int j;
+    int e;
+
+    if ( n_aliases == 0 ) {
+        return NULL;
+    }
+
+    /* Sort the names, and drop all but the first of any duplicates. */
+
+    names = allocate( n_aliases * sizeof(char *) );
+    for ( i = 0; i < n_aliases; i++ ) {
+        names[i] = alias_name( table, i );
+    }
+
+    qsort( names, n_aliases, sizeof(char *), compare_names );
+
+    n_names = 0;
+    for ( i = 0; i < n_aliases; i++ ) {
+        if ( (n_names == 0) || (strcmp( names[n_names-1], names[i] ) != 0) ) {
+            names[n_names++] = names[i];
+        }
+    }
+
+    root = new_trie_node();
+    for ( i = 0; i < n_names; i++ ) {
+        n_trie_nodes += insert_word( root, names[i] );
+    }
+
+    /* Merge equivalent states. The register can never need more slots
+       than there were nodes in the trie. */
+
+    reg.mask = 1;
+    while ( reg.mask < (unsigned int) (2 * n_trie_nodes) ) {
+        reg.mask <<= 1;
+    }
+    reg.slots = allocate_zeroed( reg.mask, sizeof(TrieNode *) );
+    reg.mask--;
+    reg.order = allocate( n_trie_nodes * sizeof(TrieNode *) );
+    reg.n_states = 0;
+
+    root = minimise( root, &reg );
+
+    /* Copy the states into flat arrays. As each state comes after its
+       children in the register's order, we can count the names
+       reachable from each state in the same pass. */
+
+    dafsa = allocate( sizeof(Dafsa) );
+    dafsa->root = root->id;
+    dafsa->n_nodes = reg.n_states;
+    dafsa->n_edges = 0;
+    dafsa->n_words = n_names;
+    dafsa->nodes = allocate( reg.n_states * sizeof(DafsaNode) );
+
+    for ( i = 0; i < reg.n_states; i++ ) {
+        dafsa->n_edges += reg.order[i]->n_children;
+    }
+    dafsa->edges = allocate( (dafsa->n_edges > 0 ? dafsa->n_edges : 1) * sizeof(DafsaEdge) );
+
+    e = 0;
+    for ( i = 0; i < reg.n_states; i++ ) {
+        TrieNode *node = reg.order[i];
+        DafsaNode *state = &(dafsa->nodes[i]);
+
+        state->first_edge = e;
+        state->n_edges = node->n_children;
+        state->final = node->final;
+        state->count = node->final;
+
+        for ( j = 0; j < node->n_children; j++ ) {
+            dafsa->edges[e].label = node->labels[j];
+            dafsa->edges[e].target = node->children[j]->id;
+            state->count += dafsa->nodes[node->children[j]->id].count;
+            e++;
+        }
+    }
+
+    dafsa->words = allocate( n_names * sizeof(int) );
+    for ( i = 0; i < n_names; i++ ) {
+        dafsa->words[i] = alias_at( table, names[i] );
+    }
+
+    for ( i = 0; i < reg.n_states; i++ ) {
+        free_trie_node( reg.order[i] );
+    }
+    deallocate( reg.order );
+    deallocate( reg.slots );
+    deallocate( names );
+
+    return dafsa;
+}
+
+/* Look up the first "length" characters of word, which need not be
+   null terminated. Returns the matching alias, or NO_ALIAS.
+
+   On the way through the automaton we count the names which sort
+   before the word: every final state we pass through is a prefix of
+   it, and every edge we skip over leads to names with a smaller
+   character in this position. */
+
+int dafsa_lookup( Dafsa *dafsa, const char *word, size_t length )
+{
+    DafsaNode *state;
+    DafsaEdge *edge;
+    DafsaEdge *last_edge;
+    unsigned char c;
+    int rank = 0;
+    size_t i;
+
+    if ( dafsa == NULL ) {
+        return NO_ALIAS;
+    }
+
+    state = &(dafsa->nodes[dafsa->root]);
+
+    for ( i = 0; i < length; i++ ) {
+        c = (unsigned char) word[i];
+
+        rank += state->final;
+
+        edge = &(dafsa->edges[state->first_edge]);
+        last_edge = edge + state->n_edges;
+        while ( (edge < last_edge) && (edge->label < c) ) {
+            rank += dafsa->nodes[edge->target].count;
+            edge++;
+        }
+
+        if ( (edge == last_edge) || (edge->label != c) ) {
+            return NO_ALIAS;
+        }
+
+        state = &(dafsa->nodes[edge->target]);
+    }
+
+    if ( state->final ) {
+        return dafsa->words[rank];
+    } else {
+        return NO_ALIAS;
+    }
+}
+
+/* The number of bytes used by the automaton, not counting the aliases
+   themselves. */
+
+size_t dafsa_size( Dafsa *dafsa )
+{
+    if ( dafsa == NULL ) {
+        return 0;
+    }
+
+    return sizeof(Dafsa) +
+        dafsa->n_nodes * sizeof(DafsaNode) +
+        dafsa->n_edges * sizeof(DafsaEdge) +
+        dafsa->n_words * sizeof(int);
+}
+
+void free_dafsa( Dafsa *dafsa )
+{
+    if ( dafsa != NULL ) {
+        deallocate( dafsa->nodes );
+        deallocate( dafsa->edges );
+        deallocate( dafsa->words );
+        deallocate( dafsa );
+    }
+}
@@ -0,0 +1,68 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DAFSA_SUPPORT_H__
+#define __DAFSA_SUPPORT_H__
+
+#include <stddef.h>
+
+#include "alias_support.h"
+
+/* An index over the alias names in the form of a minimal acyclic
+   automaton (a DAFSA). Alias names often share prefixes ("ls", "ll",
+   "l.", "lnd", "lookup") and suffixes, and the automaton stores each
+   shared part only once.
+
+   Because the automaton is minimised, a final state can't say which
+   alias it belongs to. Instead each node records how many names can
+   be reached from it, which lets a lookup work out the lexicographic
+   rank of the name it found, and the rank indexes an array holding
+   the alias with each name. */
+
+typedef struct dafsa_node {
+    int first_edge;
+    int count;
+    short n_edges;
+    char final;
+} DafsaNode;
+
+typedef struct dafsa_edge {
+    unsigned char label;
+    int target;
+} DafsaEdge;
+
+typedef struct dafsa {
+    int root;
+    int n_nodes;
+    int n_edges;
+    int n_words;
+    DafsaNode *nodes;
+    DafsaEdge *edges;
+    int *words;
+} Dafsa;
+
+Dafsa *build_dafsa( AliasTable *table );
+
+int dafsa_lookup( Dafsa *dafsa, const char *word, size_t length );
+
+size_t dafsa_size( Dafsa *dafsa );
+
+void free_dafsa( Dafsa *dafsa );
+
+
+#endif /* __DAFSA_SUPPORT_H__ */
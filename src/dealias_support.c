@@ -0,0 +1,1696 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The alias expansion engine: reading the alias table, history
+   substitution, splitting commands into simple commands and expanding
+   the aliases in them. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <error.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "list_support.h"
+#include "string_support.h"
+#include "alias_support.h"
+#include "dealias_support.h"
+#include "allocator_support.h"
+#include "pool_support.h"
+#include "stats_support.h"
+
+/* Any character in the white_space string will be taken to delimit
+   words in an alias. */
+
+char *white_space = " \f\n\r\t\v";
+
+/* Read an alias table from the text of an alias file, which becomes
+   the table's pool (see set_alias_pool()). The alias file contains one
+   line for each alias which has been defined. The first word on the
+   line is the alias, and the rest of the line what the alias expands
+   to. Each is ended with a '\0', and unquoted, where it lies, which we
+   can do because neither ever gets longer; the byte after the text
+   must be writable in case the last line has no '\n'. */
+
+static AliasTable *read_alias_pool( char *text, size_t length, size_t size, int is_mapped )
+{
+    AliasTable *result = new_alias_table();
+    size_t start = 0;
+    size_t line_end;
+    size_t name_end;
+    size_t value_start;
+    size_t value_end;
+    char *end;
+    char *nul;
+
+    set_alias_pool( result, text,
+                    ((length == 0) || (text[length-1] == '\n')) ? length : length + 1,
+                    size, is_mapped );
+
+    while ( start < length ) {
+
+        /* We're not interested in the '\n' at the end of each line,
+           and as when we copied each line, it ends at any '\0'. */
+
+        end = memchr( &(text[start]), '\n', length - start );
+        if ( end == NULL ) {
+            end = &(text[length]);
+        }
+
+        nul = memchr( &(text[start]), '\0', end - &(text[start]) );
+        line_end = ((nul != NULL) ? nul : end) - text;
+
+        /* Splitting the line between the first and second words, gives
+           us the alias and what it should expand to. */
+
+        name_end = start;
+        while ( (name_end < line_end) && !isspace( text[name_end] ) ) {
+            name_end++;
+        }
+
+        value_start = name_end;
+        while ( (value_start < line_end) && isspace( text[value_start] ) ) {
+            value_start++;
+        }
+        value_end = line_end;
+
+        /* What the alias expands to is often enclosed in "()", but we
+           don't need the brackets. Similary we can strip out any
+           unescaped quotes, i.e. '"', which is the only time that
+           anything needs to be moved. */
+
+        if ( (value_end - value_start >= 2) && (text[value_start] == '(') &&
+             (text[value_end-1] == ')') ) {
+            value_start++;
+            value_end--;
+        }
+
+        if ( memchr( &(text[value_start]), '"', value_end - value_start ) != NULL ) {
+            value_end = value_start +
+                remove_quotes_in_place( &(text[value_start]), value_end - value_start );
+        }
+
+        text[name_end] = '\0';
+        text[value_end] = '\0';
+
+        add_pooled_alias( result, start, name_end - start, value_start, value_end - value_start );
+
+        start = end - text + 1;
+    }
+
+    build_alias_index( result );
+
+    return result;
+}
+
+/* Read an alias table from a copy of the text of an alias file, which
+   the caller keeps. */
+
+AliasTable *read_alias_text( char *text, size_t length )
+{
+    char *pool = allocate( length + 1 );
+
+    memcpy( pool, text, length );
+
+    return read_alias_pool( pool, length, length + 1, 0 );
+}
+
+/* Map an alias file, so that its aliases can be read from it where
+   they lie. The mapping is private, so our changes never reach the
+   file, and populated when it is made, as nearly every page is about
+   to be written. Returns NULL if the file can't be mapped, as with a pipe,
+   or is empty, or if there is no room after the end of the file for
+   the '\0' which ends the last alias. */
+
+static char *map_alias_file( int fd, size_t *length, size_t *size )
+{
+    struct stat st;
+    size_t page_size = sysconf( _SC_PAGESIZE );
+    char *text;
+
+    if ( (fstat( fd, &st ) < 0) || !S_ISREG( st.st_mode ) || (st.st_size <= 0) ) {
+        return NULL;
+    }
+
+    text = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0 );
+    if ( text == MAP_FAILED ) {
+        return NULL;
+    }
+
+    if ( (st.st_size % page_size == 0) && (text[st.st_size-1] != '\n') ) {
+        munmap( text, st.st_size );
+        return NULL;
+    }
+
+    *length = st.st_size;
+    *size = (st.st_size + page_size - 1) / page_size * page_size;
+    return text;
+}
+
+/* Read an alias file, mapping it if may_map is non-zero and we can.
+   Otherwise the file is read without stdio, so that no memory is
+   allocated other than by the current allocator. */
+
+static AliasTable *load_alias_file( char *alias_file, int may_map )
+{
+    char *text = NULL;
+    size_t length = 0;
+    size_t size = 0;
+    ssize_t n;
+    int fd;
+
+    fd = open( alias_file, O_RDONLY );
+    if ( fd < 0 ) {
+        warn( "Unable to open file %s", alias_file );
+        return new_alias_table();
+    }
+
+    if ( may_map ) {
+        text = map_alias_file( fd, &length, &size );
+        if ( text != NULL ) {
+            close( fd );
+            return read_alias_pool( text, length, size, 1 );
+        }
+    }
+
+    /* This always leaves room after the text for read_alias_pool(). */
+
+    do {
+        if ( length == size ) {
+            size = 2 * size + 4096;
+            text = reallocate( text, size );
+        }
+        n = read( fd, &(text[length]), size - length );
+        if ( n > 0 ) {
+            length += n;
+        }
+    } while ( (n > 0) || ((n < 0) && (errno == EINTR)) );
+
+    if ( n < 0 ) {
+        warn( "Unable to read file %s", alias_file );
+    }
+
+    close( fd );
+
+    return read_alias_pool( text, length, size, 0 );
+}
+
+/* Read the contents of the alias file into memory. */
+
+AliasTable *read_alias_table( char *alias_file )
+{
+    return load_alias_file( alias_file, 0 );
+}
+
+/* As read_alias_table(), but map the alias file rather than read it,
+   which saves copying it. The table's pool is then the mapping, and
+   like any mapping of a file it faults if the file is cut short, even
+   though our copy of each page is private. So this is only for a
+   table which is used briefly, by a process which then exits, such as
+   a one-shot run of tcshParser. */
+
+AliasTable *map_alias_table( char *alias_file )
+{
+    return load_alias_file( alias_file, 1 );
+}
+
+
+/* A command is considered "empty" if it either of zero length or
+   contains only white-space characters. */
+
+int is_empty( char *command )
+{
+    while ( *command != '\0' && isspace( *command ) ) {
+        command++;
+    }
+
+    if ( *command == '\0' ) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* Split the arguments of an alias into words, once, for all the
+   history substitutions to use. As with split(), words are delimited
+   by white space, except within double quotes, which are removed. Each
+   word is followed by a '\0' in args->buffer. */
+
+void split_args( char *text, size_t length, ArgWords *args )
+{
+    int in_quote = 0;
+    size_t i;
+    size_t j = 0;
+    size_t start = 0;
+
+    args->text = text;
+    args->length = length;
+    args->buffer = allocate( length + 1 );
+    args->words = allocate( (length / 2 + 1) * sizeof(Span) );
+    args->n_words = 0;
+
+    for ( i = 0; i <= length; i++ ) {
+        if ( (i < length) && (text[i] == '"') ) {
+            in_quote = !in_quote;
+        } else if ( (i < length) && (in_quote || (strchr( white_space, text[i] ) == NULL)) ) {
+            args->buffer[j++] = text[i];
+        } else if ( j != start ) {
+            args->words[args->n_words].start = start;
+            args->words[args->n_words].length = j - start;
+            args->words[args->n_words].is_separator = 0;
+            args->n_words++;
+            args->buffer[j++] = '\0';
+            start = j;
+        }
+    }
+}
+
+void free_args( ArgWords *args )
+{
+    deallocate( args->buffer );
+    deallocate( args->words );
+}
+
+/* Trim any white space from either end of the length characters at s,
+   just as trim() does, but in place, returning the length left. */
+
+static size_t trim_in_place( char *s, size_t length )
+{
+    long begin = 0;
+    long end = (long) length - 1;
+
+    while ( (begin < end) && isspace( s[begin] ) ) {
+        begin++;
+    }
+
+    while ( (end > begin) && isspace( s[end] ) ) {
+        end--;
+    }
+
+    memmove( s, &(s[begin]), end + 1 - begin );
+    return end + 1 - begin;
+}
+
+/* Write words n through to m from the alias and its arguments to s,
+   trimmed, returning their length. By analogy with conventional
+   command line processing, argument zero is taken to mean the name of
+   the alias, and arguments 1 to length are the actual arguments. */
+
+static size_t copy_arg_words( char *s, int n, int m, char *alias, ArgWords *args )
+{
+    size_t j = 0;
+    int first_arg;
+    int i;
+    Span *word;
+
+    if ( (n > m) || (m > args->n_words) ) {
+        return 0;
+    }
+
+    if ( n == 0 ) {
+        j = strlen( alias );
+        memcpy( s, alias, j );
+        first_arg = 1;
+    } else {
+        first_arg = n;
+    }
+
+    for ( i = first_arg; i <= m; i++ ) {
+        word = &(args->words[i-1]);
+        s[j++] = ' ';
+        memcpy( &(s[j]), &(args->buffer[word->start]), word->length );
+        j += word->length;
+    }
+
+    return trim_in_place( s, j );
+}
+
+/* Before tcsh processes aliases, it stores the current command in the
+   "history", so that an alias can use history processing commands on
+   it. So, in the context of this program, "history" means the current
+   command, rather than the commands that you typed before this
+   one. */
+
+char *replace_history( char *cmd, char *alias, ArgWords *args )
+{
+    HistoryPart *parts;
+    int n_parts;
+    char *result;
+
+    n_parts = parse_history( cmd, &parts );
+    result = expand_history( parts, n_parts, cmd, alias, args );
+    deallocate( parts );
+
+    return result;
+}
+
+/* The range of words which a part of a template refers to, given the
+   arguments. */
+
+static void history_range( const HistoryPart *part, ArgWords *args, int *first, int *last )
+{
+    *first = part->first;
+    if ( part->flags & HISTORY_FIRST_FROM_END ) {
+        *first += args->n_words;
+    }
+    *last = part->last;
+    if ( part->flags & HISTORY_LAST_FROM_END ) {
+        *last += args->n_words;
+    }
+}
+
+/* The length of what expand_history() makes of a template, before it
+   is trimmed, worked out without making it, so that a substitution
+   which would be far too long can be refused before it is made. */
+
+static size_t history_length( const HistoryPart *parts, int n_parts, char *alias,
+                              ArgWords *args )
+{
+    size_t length = 0;
+    int first;
+    int last;
+    int i;
+    int j;
+
+    for ( i = 0; i < n_parts; i++ ) {
+        length += parts[i].text_length;
+
+        if ( parts[i].flags & HISTORY_WORDS ) {
+            history_range( &(parts[i]), args, &first, &last );
+
+            /* As for copy_arg_words(). */
+
+            if ( (first <= last) && (last <= args->n_words) ) {
+                if ( first == 0 ) {
+                    length += strlen( alias );
+                    first = 1;
+                }
+                for ( j = first; j <= last; j++ ) {
+                    length += 1 + args->words[j-1].length;
+                }
+            }
+        }
+    }
+
+    if ( !uses_history( parts, n_parts ) ) {
+        length += 1 + args->length;
+    }
+
+    return length;
+}
+
+/* Fill in a template for an alias's value (see history_support.h) with
+   the words of the alias and its arguments, in a single string with
+   room for the length worked out by history_length(). */
+
+static char *fill_history( const HistoryPart *parts, int n_parts, const char *value,
+                           char *alias, ArgWords *args, size_t length )
+{
+    char *result = allocate( length + 1 );
+    size_t used = 0;
+    int first;
+    int last;
+    int i;
+
+    for ( i = 0; i < n_parts; i++ ) {
+        memcpy( &(result[used]), &(value[parts[i].text_start]), parts[i].text_length );
+        used += parts[i].text_length;
+
+        if ( parts[i].flags & HISTORY_WORDS ) {
+            history_range( &(parts[i]), args, &first, &last );
+            used += copy_arg_words( &(result[used]), first, last, alias, args );
+        }
+    }
+
+    /* If we didn't find any history substitutions in the whole
+       string, then simply append the args. */
+    if ( !uses_history( parts, n_parts ) ) {
+        result[used++] = ' ';
+        memcpy( &(result[used]), args->text, args->length );
+        used += args->length;
+    }
+
+    result[used] = '\0';
+
+    return trim( result );
+}
+
+char *expand_history( const HistoryPart *parts, int n_parts, const char *value,
+                      char *alias, ArgWords *args )
+{
+    return fill_history( parts, n_parts, value, alias, args,
+                         history_length( parts, n_parts, alias, args ) );
+}
+
+/* Add a span of text to a list of simple commands. */
+
+static void add_span( CommandList *commands, int start, int length, int is_separator )
+{
+    Span *span;
+
+    if ( commands->n_spans == commands->max_spans ) {
+        commands->max_spans = 2 * commands->max_spans + 8;
+        commands->spans = reallocate( commands->spans, commands->max_spans * sizeof(Span) );
+    }
+
+    span = &(commands->spans[commands->n_spans++]);
+    span->start = start;
+    span->length = length;
+    span->is_separator = is_separator;
+}
+
+/* Break up a string into a list of simple commands, and the
+   separators between them, each of which is a span of the string.
+   The list takes over the string, and frees it along with the list. */
+
+CommandList *split_into_simple_commands( char *cmd )
+{
+    CommandList *command_list = allocate_zeroed( 1, sizeof(CommandList) );
+
+    int escaped = 0;
+    int in_single_quote = 0;
+    int in_double_quote = 0;
+    int in_backwards_quote = 0;
+
+    int start_index = 0;
+    int current_index = 0;
+    int cmd_length = strlen( cmd );
+    char c;
+    char prev_c;
+    char next_c;
+
+    //fprintf( stderr, "split_into_simple_commands(%s)\n", cmd );
+
+    while ( current_index < cmd_length ) {
+        /* It is sometimes easiest if we can look one character to the
+           right or to the left of the current position, whilst not
+           going off either end of the string. */
+
+        c = cmd[ current_index ];
+
+        if ( current_index > 0 ) {
+            prev_c = cmd[ current_index - 1 ];
+        } else {
+            prev_c = '\0';
+        }
+
+        if ( (current_index + 1) < cmd_length ) {
+            next_c = cmd[ current_index + 1 ];
+        } else {
+            next_c = '\0';
+        }
+
+        switch(c) {
+        case '\\' :
+            escaped = 1;
+            current_index++;
+            break;
+
+        case '\'' :
+            if ( escaped ) {
+                escaped = 0;
+                current_index++;
+            } else {
+                in_single_quote = !in_single_quote;
+                current_index++;
+            }
+            break;
+
+        case '\"' :
+            if ( escaped ) {
+                escaped = 0;
+                current_index++;
+            } else {
+                in_double_quote = !in_double_quote;
+                current_index++;
+            }
+            break;
+
+        case '`' :
+            if ( escaped ) {
+                escaped = 0;
+                current_index++;
+            } else {
+                in_backwards_quote = !in_backwards_quote;
+                current_index++;
+            }
+            break;
+
+        case '|' :
+        case '&' :
+        case '(' :
+        case ')' :
+        case ';' :
+            escaped = 0;
+            if (in_single_quote || in_double_quote || in_backwards_quote) {
+                current_index++;
+            } else {
+                if ( ((c == '&') && (next_c == '&')) || 
+                     ((c == '|') && (next_c == '|')) ||
+                     ((c == '|') && (next_c == '&')) ) {
+                    add_span( command_list, start_index, current_index-start_index, 0 );
+                    add_span( command_list, current_index, 2, 1 );
+                    current_index += 2;
+                    start_index = current_index;
+                } else if ( (prev_c == '>') && (c == '&') ) { // ignore >& redirect                    
+                    current_index++;
+                } else {
+                    add_span( command_list, start_index, current_index-start_index, 0 );
+                    add_span( command_list, current_index, 1, 1 );
+                    current_index++;
+                    start_index = current_index;
+                }
+            }
+            break;
+
+        case ' ' :
+        case '\t' :
+            /* If we see one or more spaces or tabs at the start of a
+               (simple) command, then keep moving start_index forward,
+               so that if we eventually find a command, we've already
+               stepped over the white space. */
+
+            if (start_index == current_index) {
+                current_index++;
+                start_index = current_index;
+            } else {
+                current_index++;
+            }
+            escaped = 0;
+            break;
+
+        default :
+            escaped = 0;
+            current_index++;
+        }
+    }
+
+    if (start_index != current_index) {
+        add_span( command_list, start_index, current_index-start_index, 0 );
+    }
+
+    command_list->text = cmd;
+
+    return command_list;
+}
+
+void free_command_list( CommandList *commands )
+{
+    deallocate( commands->text );
+    deallocate( commands->spans );
+    deallocate( commands );
+}
+
+/* If tcsh detects a loop in the aliases then it prints "Alias loop",
+   but we simply stop expanding aliases at a certain depth. This is
+   unlikely to affect any real alias expansion. */
+
+#define MAX_DEPTH 20
+
+/* Aliases are expanded by a simple machine, working through a stack
+   of things to do, each of which either expands the aliases in a
+   simple command or copies some text straight to the output. When an
+   alias is expanded, the simple commands it turns into are pushed
+   onto the stack in reverse order, so that the output is built up
+   from left to right, and the stack only ever holds the commands
+   which are still waiting to be expanded.
+
+   Each command is a span of text, which is never copied: it is part
+   either of the caller's list of commands or of the lists made by
+   expanding aliases, which are all kept until the end. Separators are
+   simply copied to the output. */
+
+typedef enum {
+    EXPAND_COMMAND,
+    COPY_TEXT,
+    END_COMMAND
+} WorkType;
+
+/* The output isn't copied as it is made either, but built up as a
+   rope: a list of pieces, each of which is either a span of text which
+   is kept until the end, or a repeat of some earlier stretch of the
+   output, such as the expansion of a remembered command (see below).
+   Only when the whole expansion is done is the rope flattened, once,
+   into a string of exactly the right length, piece by piece, so that
+   a repeat is copied from the part of the string already made. */
+
+typedef struct piece {
+    const char *text;
+    size_t start;
+    size_t length;
+} Piece;
+
+typedef struct work_item {
+    WorkType type;
+    char *text;
+    size_t length;
+    int depth;
+    size_t start;
+} WorkItem;
+
+/* Once a command with an alias has been expanded, its expansion is
+   remembered, so that if the same command turns up again at the same
+   depth, as it does in "echo !:1 ; echo !:1", the expansion can simply
+   be repeated. This only needs to catch commands which are repeated
+   close together, so a small table, with each entry overwriting any
+   previous one in its slot, is enough. */
+
+#define N_REMEMBERED 64
+
+typedef struct remembered {
+    char *text;
+    size_t length;
+    int depth;
+    size_t start;
+    size_t end;
+} Remembered;
+
+/* Expanding one command line is limited in the number of steps the
+   machine takes, the length of its output, and the time it takes, so
+   that aliases which, say, repeat their arguments to an alias which
+   does the same can't tie up a thread or the memory indefinitely. The
+   budget is shared by all the threads expanding parts of a command
+   line, which add their steps to it every BUDGET_CHECK_STEPS steps,
+   and check the time as they do so. Making an alias substitution
+   counts as a step for every SUBSTITUTION_STEP_BYTES bytes it makes,
+   and a long one is checked before it is made, so that a few very long
+   substitutions are stopped as soon as many short ones would be. */
+
+#define BUDGET_CHECK_STEPS 256
+#define SUBSTITUTION_STEP_BYTES 4096
+
+static size_t max_output = DEFAULT_MAX_OUTPUT;
+static unsigned long max_steps = DEFAULT_MAX_STEPS;
+static unsigned long long max_nanoseconds = DEFAULT_MAX_SECONDS * 1000000000ull;
+
+typedef struct budget {
+    unsigned long steps;
+    unsigned long long deadline;
+    int error;
+} Budget;
+
+/* Set the limits on expanding a command line, where zero means no
+   limit. These apply to all threads, and should be set before any
+   expansion starts. */
+
+void set_expansion_limits( size_t output, unsigned long steps, double seconds )
+{
+    max_output = output;
+    max_steps = steps;
+    max_nanoseconds = seconds * 1e9;
+}
+
+static unsigned long long now_in_nanoseconds( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void start_budget( Budget *budget )
+{
+    budget->steps = 0;
+    budget->deadline = (max_nanoseconds > 0) ? now_in_nanoseconds() + max_nanoseconds : 0;
+    budget->error = 0;
+}
+
+/* Note that a limit has been reached. Only the first limit reached is
+   kept. */
+
+static void overspend( Budget *budget, int error )
+{
+    int none = 0;
+
+    __atomic_compare_exchange_n( &(budget->error), &none, error, 0,
+                                 __ATOMIC_RELAXED, __ATOMIC_RELAXED );
+}
+
+static int overspent( Budget *budget )
+{
+    return __atomic_load_n( &(budget->error), __ATOMIC_RELAXED ) != 0;
+}
+
+/* Add some steps to the budget, and check the time. Returns non-zero
+   if any limit has been reached, by this thread or another. */
+
+static int spend_steps( Budget *budget, unsigned long steps )
+{
+    unsigned long total = __atomic_add_fetch( &(budget->steps), steps, __ATOMIC_RELAXED );
+
+    if ( (max_steps > 0) && (total > max_steps) ) {
+        overspend( budget, EXPANSION_TOO_MANY_STEPS );
+    } else if ( (budget->deadline > 0) && (now_in_nanoseconds() > budget->deadline) ) {
+        overspend( budget, EXPANSION_TOO_SLOW );
+    }
+
+    return overspent( budget );
+}
+
+/* A description of the error with which an expansion failed. */
+
+const char *expansion_error_message( int error )
+{
+    switch ( error ) {
+    case EXPANSION_TOO_LONG:
+        return "the expanded command is longer than the output limit";
+    case EXPANSION_TOO_MANY_STEPS:
+        return "expanding the command takes more than the step limit";
+    case EXPANSION_TOO_SLOW:
+        return "expanding the command takes longer than the time limit";
+    default:
+        return strerror( error );
+    }
+}
+
+typedef struct expansion {
+    Budget *budget;
+    unsigned long steps;
+    int failed;
+    WorkItem *stack;
+    int n_items;
+    int max_items;
+    CommandList **lists;
+    int n_lists;
+    int max_lists;
+    Piece *pieces;
+    size_t n_pieces;
+    size_t max_pieces;
+    size_t used;
+    Remembered remembered[N_REMEMBERED];
+} Expansion;
+
+static void push_item( Expansion *e, WorkType type, char *text, size_t length,
+                       int depth, size_t start )
+{
+    WorkItem *item;
+
+    if ( e->n_items == e->max_items ) {
+        e->max_items = 2 * e->max_items + 16;
+        e->stack = reallocate( e->stack, e->max_items * sizeof(WorkItem) );
+    }
+
+    item = &(e->stack[e->n_items++]);
+    item->type = type;
+    item->text = text;
+    item->length = length;
+    item->depth = depth;
+    item->start = start;
+}
+
+/* Reverse the items pushed since the stack held n_items, so that they
+   can be pushed in the order in which they should be done. */
+
+static void reverse_items( Expansion *e, int n_items )
+{
+    WorkItem item;
+    int i = n_items;
+    int j = e->n_items - 1;
+
+    while ( i < j ) {
+        item = e->stack[i];
+        e->stack[i++] = e->stack[j];
+        e->stack[j--] = item;
+    }
+}
+
+static void keep_list( Expansion *e, CommandList *list )
+{
+    if ( e->n_lists == e->max_lists ) {
+        e->max_lists = 2 * e->max_lists + 16;
+        e->lists = reallocate( e->lists, e->max_lists * sizeof(CommandList *) );
+    }
+
+    e->lists[e->n_lists++] = list;
+}
+
+/* Add a piece of output: either some text, or if text is NULL a
+   repeat of the output from start. Marks the expansion as failed if
+   that would take the output over the limit. */
+
+static void add_piece( Expansion *e, const char *text, size_t start, size_t length )
+{
+    Piece *piece;
+
+    if ( (max_output > 0) && (e->used + length > max_output) ) {
+        overspend( e->budget, EXPANSION_TOO_LONG );
+        e->failed = 1;
+        return;
+    }
+
+    if ( length == 0 ) {
+        return;
+    }
+
+    /* Neighbouring spans of the same text, such as a command and the
+       separator after it, make a single piece. */
+
+    if ( (e->n_pieces > 0) && (text != NULL) ) {
+        piece = &(e->pieces[e->n_pieces - 1]);
+        if ( (piece->text != NULL) && (piece->text + piece->length == text) ) {
+            piece->length += length;
+            e->used += length;
+            return;
+        }
+    }
+
+    if ( e->n_pieces == e->max_pieces ) {
+        e->max_pieces = 2 * e->max_pieces + 16;
+        e->pieces = reallocate( e->pieces, e->max_pieces * sizeof(Piece) );
+    }
+
+    piece = &(e->pieces[e->n_pieces++]);
+    piece->text = text;
+    piece->start = start;
+    piece->length = length;
+    e->used += length;
+}
+
+static void copy_to_output( Expansion *e, const char *text, size_t length )
+{
+    add_piece( e, text, 0, length );
+}
+
+static Remembered *remembered_slot( Expansion *e, char *text, size_t length, int depth )
+{
+    unsigned int hash = 2166136261u ^ depth;
+    size_t i;
+
+    for ( i = 0; i < length; i++ ) {
+        hash = (hash ^ (unsigned char) text[i]) * 16777619u;
+    }
+
+    return &(e->remembered[hash % N_REMEMBERED]);
+}
+
+/* Expand a single simple command, either copying it to the output or
+   pushing the work of expanding its alias onto the stack. */
+
+static void expand_command( Expansion *e, char *command, size_t length, int depth,
+                            AliasTable *aliases )
+{
+    size_t first_word_length;
+    size_t i;
+    int alias;
+    int ends_with_space;
+    ArgWords args;
+    char *aliased_command;
+    CommandList *commands;
+    Span *span;
+    int n_items;
+    int first_word_changed;
+    const HistoryPart *parts;
+    HistoryPart *parsed;
+    size_t substitution_length;
+    int n_parts;
+    Remembered *slot;
+    unsigned long long start;
+
+    if ( depth >= MAX_DEPTH ) {
+        copy_to_output( e, command, length );
+        return;
+    }
+
+    /* Most commands don't start with an alias. If the alias table's
+       filter tells us that the first word can't be an alias, then we
+       can copy the command as it is. An empty command has an empty
+       first word, which is never an alias. */
+
+    i = 0;
+    while ( (i < length) && isspace( command[i] ) ) {
+        i++;
+    }
+    if ( i == length ) {
+        copy_to_output( e, command, length );
+        return;
+    }
+
+    first_word_length = 0;
+    while ( (first_word_length < length) && !isspace( command[first_word_length] ) ) {
+        first_word_length++;
+    }
+
+    if ( !might_be_alias( aliases, command, first_word_length ) ) {
+        copy_to_output( e, command, length );
+        return;
+    }
+
+    /* The filter can give false positives, so look the first word up
+       in the table, again without copying it. */
+
+    alias = find_alias( aliases, command, first_word_length );
+    if ( alias == NO_ALIAS ) {
+        copy_to_output( e, command, length );
+        return;
+    }
+
+    /* Perhaps we've just expanded this very command. */
+
+    slot = remembered_slot( e, command, length, depth );
+    if ( (slot->text != NULL) && (slot->length == length) && (slot->depth == depth) &&
+         (memcmp( slot->text, command, length ) == 0) ) {
+        add_piece( e, NULL, slot->start, slot->end - slot->start );
+        return;
+    }
+
+    /* The arguments follow the first word and any white space. */
+
+    i = first_word_length;
+    while ( (i < length) && isspace( command[i] ) ) {
+        i++;
+    }
+    ends_with_space = (command[length-1] == ' ');
+
+    /* Replace references to the "history" with values from the
+       original command and arguments. */
+
+    start = start_phase();
+    split_args( &(command[i]), length - i, &args );
+    parsed = NULL;
+    n_parts = alias_history( aliases, alias, &parts );
+    if ( n_parts < 0 ) {
+        n_parts = parse_history( alias_value( aliases, alias ), &parsed );
+        parts = parsed;
+    }
+
+    /* Aliases which repeat their arguments to other aliases which do
+       the same can make each substitution several times longer than
+       the one before, so a substitution which alone would be longer
+       than the output limit isn't even started. */
+
+    substitution_length = history_length( parts, n_parts, alias_name( aliases, alias ), &args );
+    e->steps += substitution_length / SUBSTITUTION_STEP_BYTES;
+
+    if ( (max_output > 0) && (substitution_length > max_output) ) {
+        overspend( e->budget, EXPANSION_TOO_LONG );
+        e->failed = 1;
+    } else if ( e->steps >= BUDGET_CHECK_STEPS ) {
+        e->failed = spend_steps( e->budget, e->steps );
+        e->steps = 0;
+    }
+
+    if ( e->failed ) {
+        aliased_command = NULL;
+    } else {
+        aliased_command = fill_history( parts, n_parts, alias_value( aliases, alias ),
+                                        alias_name( aliases, alias ), &args,
+                                        substitution_length );
+    }
+    deallocate( parsed );
+    free_args( &args );
+    end_phase( PHASE_HISTORY, start );
+
+    if ( aliased_command == NULL ) {
+        return;
+    }
+
+    /* If the process so far has changed the first word of the
+       command, then we need to see whether it is itself an alias. */
+
+    i = 0;
+    while ( (aliased_command[i] != '\0') && !isspace( aliased_command[i] ) ) {
+        i++;
+    }
+    first_word_changed = (i != first_word_length) ||
+                         (memcmp( aliased_command, command, i ) != 0);
+
+    /* Expanding the alias may very well have generated a number of
+       sub-commands, so we must again split into simple commands. */
+
+    start = start_phase();
+    commands = split_into_simple_commands( aliased_command );
+    end_phase( PHASE_SPLIT, start );
+    keep_list( e, commands );
+
+    /* Once everything else is done, remember what we made of this
+       command, and add back any space at the end of it. */
+
+    push_item( e, END_COMMAND, command, length, depth, e->used );
+    if ( ends_with_space ) {
+        push_item( e, COPY_TEXT, " ", 1, depth, 0 );
+    }
+
+    /* Before that, the first of the simple commands, followed by the
+       rest of them, each preceded by a space. */
+
+    n_items = e->n_items;
+
+    for ( span = commands->spans; span < commands->spans + commands->n_spans; span++ ) {
+        if ( span > commands->spans ) {
+            push_item( e, COPY_TEXT, " ", 1, depth, 0 );
+        }
+        push_item( e, (span->is_separator || ((span == commands->spans) && !first_word_changed)) ?
+                   COPY_TEXT : EXPAND_COMMAND,
+                   &(commands->text[span->start]), span->length, depth + 1, 0 );
+    }
+
+    reverse_items( e, n_items );
+}
+
+/* Expand the simple commands and separators from first up to but not
+   including last in a list of commands, into a rope which the caller
+   should flatten_expansion() and then free_expansion(). Returns -1 if
+   the budget runs out. */
+
+static int run_expansion( Expansion *e, CommandList *commands, int first, int last,
+                          AliasTable *aliases, Budget *budget )
+{
+    WorkItem item;
+    Remembered *slot;
+    int i;
+
+    memset( e, 0, sizeof(Expansion) );
+    e->budget = budget;
+
+    for ( i = last - 1; i >= first; i-- ) {
+        push_item( e, commands->spans[i].is_separator ? COPY_TEXT : EXPAND_COMMAND,
+                   &(commands->text[commands->spans[i].start]), commands->spans[i].length, 0, 0 );
+    }
+
+    while ( (e->n_items > 0) && !e->failed ) {
+        if ( ++e->steps >= BUDGET_CHECK_STEPS ) {
+            e->failed = spend_steps( budget, e->steps );
+            e->steps = 0;
+        }
+
+        item = e->stack[--e->n_items];
+
+        switch ( item.type ) {
+        case EXPAND_COMMAND:
+            expand_command( e, item.text, item.length, item.depth, aliases );
+            break;
+
+        case COPY_TEXT:
+            copy_to_output( e, item.text, item.length );
+            break;
+
+        case END_COMMAND:
+            slot = remembered_slot( e, item.text, item.length, item.depth );
+            slot->text = item.text;
+            slot->length = item.length;
+            slot->depth = item.depth;
+            slot->start = item.start;
+            slot->end = e->used;
+            break;
+        }
+    }
+
+    if ( !e->failed ) {
+        e->failed = spend_steps( budget, e->steps );
+    }
+
+    return e->failed ? -1 : 0;
+}
+
+/* Write out the whole of an expansion's rope, which has e->used
+   characters. */
+
+static void flatten_expansion( Expansion *e, char *output )
+{
+    Piece *piece;
+    size_t used = 0;
+
+    for ( piece = e->pieces; piece < e->pieces + e->n_pieces; piece++ ) {
+        memcpy( &(output[used]), (piece->text != NULL) ? piece->text : &(output[piece->start]),
+                piece->length );
+        used += piece->length;
+    }
+}
+
+static void free_expansion( Expansion *e )
+{
+    int i;
+
+    for ( i = 0; i < e->n_lists; i++ ) {
+        free_command_list( e->lists[i] );
+    }
+    deallocate( e->lists );
+    deallocate( e->stack );
+    deallocate( e->pieces );
+}
+
+/* As above, returning the result, and setting its length, or NULL if
+   the budget runs out. */
+
+static char *expand_spans( CommandList *commands, int first, int last,
+                           AliasTable *aliases, Budget *budget, size_t *length )
+{
+    Expansion e;
+    char *result = NULL;
+
+    if ( run_expansion( &e, commands, first, last, aliases, budget ) == 0 ) {
+        result = allocate( e.used + 1 );
+        flatten_expansion( &e, result );
+        result[e.used] = '\0';
+        *length = e.used;
+    }
+    free_expansion( &e );
+
+    return result;
+}
+
+/* Very long command lines, such as generated scripts joined up into
+   one line, can be split into chunks of simple commands which are
+   expanded independently by a pool of threads, and their ropes then
+   flattened one after another into the result. Each chunk should be
+   big enough to be worth handing to another thread. */
+
+#define MIN_CHUNK_SPANS 256
+
+#define CHUNKS_PER_THREAD 4
+
+typedef struct chunk {
+    CommandList *commands;
+    int first;
+    int last;
+    AliasTable *aliases;
+    Budget *budget;
+    Expansion expansion;
+} Chunk;
+
+static ThreadPool *expansion_pool = NULL;
+static int parallel_min_commands = 0;
+
+/* Expand command lines with at least min_commands simple commands in
+   parallel, using the pool's threads, or never if pool is NULL. The
+   current allocator must be thread safe. */
+
+void set_parallel_expansion( ThreadPool *pool, int min_commands )
+{
+    expansion_pool = pool;
+    parallel_min_commands = min_commands;
+}
+
+static void expand_chunk( void *argument )
+{
+    Chunk *chunk = argument;
+
+    /* Running out of budget is noted in the budget itself. */
+
+    run_expansion( &(chunk->expansion), chunk->commands, chunk->first, chunk->last,
+                   chunk->aliases, chunk->budget );
+}
+
+static char *expand_in_parallel( CommandList *commands, AliasTable *aliases, Budget *budget )
+{
+    Chunk *chunks;
+    void **arguments;
+    int n_chunks;
+    int i;
+    size_t length = 0;
+    char *result;
+
+    n_chunks = CHUNKS_PER_THREAD * (expansion_pool->n_threads + 1);
+    if ( n_chunks > commands->n_spans / MIN_CHUNK_SPANS ) {
+        n_chunks = commands->n_spans / MIN_CHUNK_SPANS;
+    }
+    if ( n_chunks < 1 ) {
+        n_chunks = 1;
+    }
+
+    chunks = allocate( n_chunks * sizeof(Chunk) );
+    arguments = allocate( n_chunks * sizeof(void *) );
+
+    for ( i = 0; i < n_chunks; i++ ) {
+        chunks[i].commands = commands;
+        chunks[i].first = (int) ((long long) commands->n_spans * i / n_chunks);
+        chunks[i].last = (int) ((long long) commands->n_spans * (i + 1) / n_chunks);
+        chunks[i].aliases = aliases;
+        chunks[i].budget = budget;
+        arguments[i] = &(chunks[i]);
+    }
+
+    run_tasks( expansion_pool, expand_chunk, arguments, n_chunks );
+
+    /* Each chunk was held to the output limit, but all of them
+       together may be over it. */
+
+    for ( i = 0; i < n_chunks; i++ ) {
+        length += chunks[i].expansion.used;
+    }
+    if ( (max_output > 0) && (length > max_output) ) {
+        overspend( budget, EXPANSION_TOO_LONG );
+    }
+
+    result = overspent( budget ) ? NULL : allocate( length + 1 );
+    length = 0;
+    for ( i = 0; i < n_chunks; i++ ) {
+        if ( result != NULL ) {
+            flatten_expansion( &(chunks[i].expansion), &(result[length]) );
+            length += chunks[i].expansion.used;
+        }
+        free_expansion( &(chunks[i].expansion) );
+    }
+    if ( result != NULL ) {
+        result[length] = '\0';
+    }
+
+    deallocate( arguments );
+    deallocate( chunks );
+
+    return result;
+}
+
+/* Expand any aliases in a list of "simple" commands, as made by
+   split_into_simple_commands(), and join up the results, although of
+   course the process of expanding any aliases may create sub-commands
+   within them. The result is only turned back into a string once, at
+   the very end. Returns NULL if the budget runs out. */
+
+static char *expand_within_budget( CommandList *commands, AliasTable *aliases, Budget *budget )
+{
+    size_t length;
+
+    /* Simple commands alternate with the separators between them. */
+
+    if ( (expansion_pool != NULL) && (parallel_min_commands > 0) &&
+         ((commands->n_spans + 1) / 2 >= parallel_min_commands) ) {
+        return expand_in_parallel( commands, aliases, budget );
+    }
+
+    return expand_spans( commands, 0, commands->n_spans, aliases, budget, &length );
+}
+
+/* As above, with a budget of its own. Returns NULL, with errno set to
+   one of the EXPANSION_ errors, if it runs out. */
+
+char *expand_aliases( CommandList *commands, AliasTable *aliases )
+{
+    Budget budget;
+    char *result;
+
+    start_budget( &budget );
+    result = expand_within_budget( commands, aliases, &budget );
+    if ( result == NULL ) {
+        errno = budget.error;
+    }
+
+    return result;
+}
+
+/* Expand aliases in a command, which is not necessarily a "simple"
+   command. */
+
+static char *dealias_within_budget( char *command, AliasTable *aliases, Budget *budget )
+{
+    CommandList *commands;
+    char *result;
+    unsigned long long start;
+
+    /* Split the command into a list of simple commands, and expand any
+       aliases in each of these. */
+
+    start = start_phase();
+    commands = split_into_simple_commands( copy_string( command ) );
+    end_phase( PHASE_SPLIT, start );
+    result = expand_within_budget( commands, aliases, budget );
+    free_command_list( commands );
+
+    return result;
+}
+
+char *dealias_command( char *command, AliasTable *aliases )
+{
+    Budget budget;
+    char *result;
+
+    start_budget( &budget );
+    result = dealias_within_budget( command, aliases, &budget );
+    if ( result == NULL ) {
+        errno = budget.error;
+    }
+
+    return result;
+}
+
+/* The final form of an expanded command is built up here, one
+   character at a time, by finish_command(). With "unquote", each
+   character is dealt with as remove_quotes() and then
+   remove_backslash( s, '!' ) would deal with it: quotes are dropped
+   unless they are escaped, and "\!" becomes "!". With "words", the
+   command is also split into words, each followed by a '\0'. */
+
+typedef struct finished_command {
+    char *text;
+    size_t used;
+    size_t size;
+    int unquote;
+    int escaped;
+    int words;
+    int in_word;
+} FinishedCommand;
+
+static void finish_char( FinishedCommand *f, char c )
+{
+    if ( f->unquote ) {
+        if ( f->escaped ) {
+            f->escaped = 0;
+        } else if ( c == '\\' ) {
+            f->escaped = 1;
+        } else if ( c == '"' ) {
+            return;
+        }
+
+        if ( (c == '!') && (f->used > 0) && (f->text[f->used - 1] == '\\') ) {
+            f->text[f->used - 1] = '!';
+            return;
+        }
+    }
+
+    if ( f->used == f->size ) {
+        f->size = 2 * f->size + 64;
+        f->text = reallocate( f->text, f->size );
+    }
+    f->text[f->used++] = c;
+}
+
+/* Add a character which isn't within back-ticks to the finished
+   command. With "words", white space which is neither quoted nor
+   escaped ends the word before it, if there is one. */
+
+static void finish_word_char( FinishedCommand *f, char c, int in_quote )
+{
+    if ( f->words && !in_quote && !f->escaped && (strchr( white_space, c ) != NULL) ) {
+        if ( f->in_word ) {
+            finish_char( f, '\0' );
+            f->in_word = 0;
+        }
+        return;
+    }
+
+    finish_char( f, c );
+    f->in_word = 1;
+}
+
+/* Expand any aliases in a command within back-ticks, and add it to
+   the finished command, back-ticks and all, as part of one word. Returns -1 if the budget
+   runs out. */
+
+static int finish_sub_command( FinishedCommand *f, char *command, AliasTable *aliases,
+                               Budget *budget )
+{
+    unsigned long long start = start_phase();
+    char *dealiased = dealias_within_budget( command, aliases, budget );
+    char *p;
+
+    end_phase( PHASE_BACK_TICKS, start );
+
+    if ( dealiased == NULL ) {
+        return -1;
+    }
+
+    if ( (max_output > 0) && (f->used + strlen( dealiased ) + 2 > max_output) ) {
+        overspend( budget, EXPANSION_TOO_LONG );
+        deallocate( dealiased );
+        return -1;
+    }
+
+    finish_char( f, '`' );
+    for ( p = dealiased; *p != '\0'; p++ ) {
+        finish_char( f, *p );
+    }
+    finish_char( f, '`' );
+    f->in_word = 1;
+
+    deallocate( dealiased );
+    return 0;
+}
+
+/* Any text within "back-ticks" is treated as a sub-command, and as
+   such we need to expand any aliases it may contain. This takes over
+   the expanded command, and returns it, with its length in *length,
+   after a single pass which both expands the sub-commands and, with
+   "unquote", removes the quotes and backslashes. With "words" the
+   result is split into words, each followed by a '\0', which must be
+   done here, while we can still see which white space is quoted and
+   which is within back-ticks. Returns NULL, and frees the command, if
+   the budget runs out.
+
+   The command is divided up as split( command, "`" ) would divide it:
+   the back-ticks within double quotes don't count, the double quotes
+   themselves are dropped, and empty pieces are skipped, so that
+   every second piece is a sub-command. Most commands have no
+   back-ticks, and then the result is never longer than the command,
+   so it is written over the command. */
+
+static char *finish_command( char *command, AliasTable *aliases, int unquote, int words,
+                             Budget *budget, size_t *length )
+{
+    FinishedCommand f;
+    char *sub_command = NULL;
+    size_t sub_length = 0;
+    size_t command_length = strlen( command );
+    int in_quote = 0;
+    int n_pieces = 0;
+    int in_piece = 0;
+    int failed = 0;
+    size_t i;
+
+    f.unquote = unquote;
+    f.escaped = 0;
+    f.words = words;
+    f.in_word = 0;
+    f.used = 0;
+
+    /* The last word's '\0' can make the words one longer than the
+       command, so they are never written over it. */
+
+    if ( !words && (memchr( command, '`', command_length ) == NULL) ) {
+        if ( !unquote && (memchr( command, '"', command_length ) == NULL) ) {
+            *length = command_length;
+            return command;
+        }
+        f.text = command;
+        f.size = command_length + 1;
+    } else {
+        f.text = allocate( command_length + 2 );
+        f.size = command_length + 2;
+        sub_command = allocate( command_length + 1 );
+    }
+
+    for ( i = 0; (i < command_length) && !failed; i++ ) {
+        if ( command[i] == '"' ) {
+            in_quote = !in_quote;
+            f.in_word = 1;
+        } else if ( in_quote || (command[i] != '`') ) {
+            if ( (n_pieces % 2) == 0 ) {
+                finish_word_char( &f, command[i], in_quote );
+            } else {
+                sub_command[sub_length++] = command[i];
+            }
+            in_piece = 1;
+        } else if ( in_piece ) {
+            if ( (n_pieces % 2) != 0 ) {
+                sub_command[sub_length] = '\0';
+                failed = (finish_sub_command( &f, sub_command, aliases, budget ) < 0);
+                sub_length = 0;
+            }
+            n_pieces++;
+            in_piece = 0;
+        }
+    }
+
+    if ( in_piece && ((n_pieces % 2) != 0) && !failed ) {
+        sub_command[sub_length] = '\0';
+        failed = (finish_sub_command( &f, sub_command, aliases, budget ) < 0);
+    }
+
+    if ( f.in_word && words ) {
+        finish_char( &f, '\0' );
+    }
+    finish_char( &f, '\0' );
+    *length = f.used - 1;
+
+    if ( f.text != command ) {
+        deallocate( command );
+    }
+    deallocate( sub_command );
+
+    if ( failed ) {
+        deallocate( f.text );
+        return NULL;
+    }
+
+    return f.text;
+}
+
+char *process_back_ticks( char *command, AliasTable *aliases )
+{
+    Budget budget;
+    size_t length;
+    char *result;
+
+    start_budget( &budget );
+    result = finish_command( copy_string( command ), aliases, 0, 0, &budget, &length );
+    if ( result == NULL ) {
+        errno = budget.error;
+    }
+
+    return result;
+}
+
+/* Characters which, on their own, separate or redirect commands. */
+
+static char *operator_chars = ";&|()<>";
+
+/* Does an argv word need quoting to stay a single word? Words made up
+   only of operators, like "&&" or ";", are left alone so that they
+   still separate commands, as they would have done for the shell. */
+
+static int needs_quotes( char *word )
+{
+    char *p;
+    int all_operators = 1;
+    int special = 0;
+
+    if ( *word == '\0' ) {
+        return 1;
+    }
+
+    for ( p = word; *p != '\0'; p++ ) {
+        if ( strchr( operator_chars, *p ) == NULL ) {
+            all_operators = 0;
+        }
+        if ( (strchr( white_space, *p ) != NULL) || (strchr( operator_chars, *p ) != NULL) ) {
+            special = 1;
+        }
+    }
+
+    return special && !all_operators;
+}
+
+/* Join a sequence of words, each terminated by '\0', into a command
+   in which each of them is still a single word. */
+
+static char *quote_words( char *words, size_t length )
+{
+    char *result = allocate( 2 * length + 1 );
+    char *word = words;
+    char *end = words + length;
+    char *p;
+    int j = 0;
+    int quote;
+
+    while ( word < end ) {
+        if ( j > 0 ) {
+            result[j++] = ' ';
+        }
+
+        quote = needs_quotes( word );
+        if ( quote ) {
+            result[j++] = '"';
+        }
+
+        for ( p = word; *p != '\0'; p++ ) {
+            if ( quote && (*p == '"') ) {
+                result[j++] = '\\';
+            }
+            result[j++] = *p;
+        }
+
+        if ( quote ) {
+            result[j++] = '"';
+        }
+
+        word = p + 1;
+    }
+
+    result[j] = '\0';
+    return result;
+}
+
+/* Take a command line, and return a new string with all the aliases
+   expanded. The original command is not changed.
+
+   Usually the command is a string, as typed by the user, and the
+   result is in exactly the form in which it should be printed. With
+   EXPAND_ARGV, the command is instead "length" bytes of words, each
+   terminated by '\0', which have already been split up by the shell.
+   With EXPAND_NUL_WORDS, the result is the words of the expanded
+   command, each terminated by '\0', ready for execvp(). In either
+   case the length of the result is returned in *result_length.
+
+   If expanding the command goes over one of the limits set by
+   set_expansion_limits(), returns NULL, with errno set to
+   EXPANSION_TOO_LONG, EXPANSION_TOO_MANY_STEPS or
+   EXPANSION_TOO_SLOW. */
+
+char *expand_command_line( char *command, size_t length, int flags,
+                           AliasTable *aliases, size_t *result_length )
+{
+    char *cmd;
+    char *dealiased;
+    char *result = NULL;
+    unsigned long long start;
+    Budget budget;
+
+    start_budget( &budget );
+
+    if ( flags & EXPAND_ARGV ) {
+        cmd = quote_words( command, length );
+    } else {
+
+        /* If the command is enclosed in double quotes then remove
+           the double quote from both ends. */
+
+        cmd = get_string_in_quotes( trim( copy_substring( command, length ) ) );
+    }
+
+    dealiased = dealias_within_budget( cmd, aliases, &budget );
+    deallocate( cmd );
+    if ( dealiased == NULL ) {
+        errno = budget.error;
+        return NULL;
+    }
+
+    /* Any sub commands (contained in back ticks) may themselves
+       contain aliases which need to be expanded, and the quotes (")
+       and the backslashes in "\!" are removed, and if we want the
+       words the command split into them, all in one pass. */
+
+    start = start_phase();
+    result = finish_command( dealiased, aliases, 1, (flags & EXPAND_NUL_WORDS) != 0, &budget,
+                             result_length );
+    end_phase( PHASE_POST, start );
+
+    if ( result == NULL ) {
+        errno = budget.error;
+    }
+
+    return result;
+}
+
+/* Take a command line, as typed by the user, and return a new string
+   with all the aliases expanded, in exactly the form in which it
+   should be printed, or NULL, as for expand_command_line(). The
+   original command is not changed. */
+
+char *dealias_command_line( char *command, AliasTable *aliases )
+{
+    size_t length;
+
+    return expand_command_line( command, strlen( command ), 0, aliases, &length );
+}
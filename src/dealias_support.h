@@ -0,0 +1,114 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DEALIAS_SUPPORT_H__
+#define __DEALIAS_SUPPORT_H__
+
+#include <stddef.h>
+#include <errno.h>
+
+#include "list_support.h"
+#include "alias_support.h"
+#include "pool_support.h"
+
+AliasTable *read_alias_text( char *text, size_t length );
+
+AliasTable *read_alias_table( char *alias_file );
+
+AliasTable *map_alias_table( char *alias_file );
+
+/* A span of a string: a word, a simple command, or a separator
+   between simple commands. */
+
+typedef struct span {
+    size_t start;
+    size_t length;
+    int is_separator;
+} Span;
+
+/* The arguments of an alias, as given, and split into words for
+   history substitutions. The words are spans of buffer, each followed
+   by a '\0'. */
+
+typedef struct arg_words {
+    char *text;
+    size_t length;
+    char *buffer;
+    Span *words;
+    int n_words;
+} ArgWords;
+
+/* A command broken up into simple commands and the separators between
+   them, as spans of text. */
+
+typedef struct command_list {
+    char *text;
+    Span *spans;
+    int n_spans;
+    int max_spans;
+} CommandList;
+
+void split_args( char *text, size_t length, ArgWords *args );
+
+void free_args( ArgWords *args );
+
+char *replace_history( char *cmd, char *alias, ArgWords *args );
+
+char *expand_history( const HistoryPart *parts, int n_parts, const char *value,
+                      char *alias, ArgWords *args );
+
+CommandList *split_into_simple_commands( char *cmd );
+
+void free_command_list( CommandList *commands );
+
+char *expand_aliases( CommandList *commands, AliasTable *aliases );
+
+void set_parallel_expansion( ThreadPool *pool, int min_commands );
+
+/* The default limits on expanding a single command line, and the
+   errno values with which expansion fails when one of them is
+   reached. A limit of zero means no limit at all. */
+
+#define DEFAULT_MAX_OUTPUT (64 * 1024 * 1024)
+#define DEFAULT_MAX_STEPS 10000000
+#define DEFAULT_MAX_SECONDS 10
+
+#define EXPANSION_TOO_LONG E2BIG
+#define EXPANSION_TOO_MANY_STEPS ELOOP
+#define EXPANSION_TOO_SLOW ETIMEDOUT
+
+void set_expansion_limits( size_t output, unsigned long steps, double seconds );
+
+const char *expansion_error_message( int error );
+
+char *dealias_command( char *command, AliasTable *aliases );
+
+char *process_back_ticks( char *command, AliasTable *aliases );
+
+/* Flags for expand_command_line(). */
+
+#define EXPAND_ARGV 1
+#define EXPAND_NUL_WORDS 2
+
+char *expand_command_line( char *command, size_t length, int flags,
+                           AliasTable *aliases, size_t *result_length );
+
+char *dealias_command_line( char *command, AliasTable *aliases );
+
+
+#endif /* __DEALIAS_SUPPORT_H__ */
@@ -0,0 +1,444 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "disk_cache_support.h"
+#include "allocator_support.h"
+
+#define CACHE_FILE "expansions"
+
+#define CACHE_MAGIC "TPXCACHE"
+#define CACHE_MAGIC_LENGTH 8
+#define CACHE_VERSION 1
+
+#define N_BUCKETS 4096
+
+/* Once the file reaches this size it is replaced by an empty one. */
+
+#define MAX_CACHE_FILE (64 * 1024 * 1024)
+
+/* The file starts with a header, holding the offset of the first entry
+   in each bucket, or zero for an empty bucket. Each entry is followed
+   by the command and the result, padded out to a multiple of 8 bytes,
+   and holds the offset of the next entry in its bucket. Entries are
+   only ever added at the end of the file, so each chain leads back
+   towards the start of the file. */
+
+typedef struct cache_file_header {
+    char magic[CACHE_MAGIC_LENGTH];
+    unsigned int version;
+    unsigned int n_buckets;
+    unsigned long long buckets[N_BUCKETS];
+} CacheFileHeader;
+
+typedef struct cache_record {
+    unsigned long long next;
+    unsigned long long file_hash;
+    unsigned int flags;
+    unsigned int command_length;
+    unsigned int result_length;
+    unsigned int padding;
+} CacheRecord;
+
+#define RECORD_SIZE(command_length, result_length) \
+    ((sizeof(CacheRecord) + (command_length) + (result_length) + 7) & ~(size_t) 7)
+
+/* A 64 bit FNV-1a hash, carrying on from a previous hash. */
+
+static unsigned long long hash_bytes( unsigned long long hash, const void *data, size_t length )
+{
+    const unsigned char *p = data;
+    size_t i;
+
+    for ( i = 0; i < length; i++ ) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+#define HASH_START 14695981039346656037ULL
+
+static unsigned int bucket_of( unsigned long long file_hash, int flags,
+                               char *command, size_t length )
+{
+    unsigned long long hash = HASH_START;
+
+    hash = hash_bytes( hash, &file_hash, sizeof(file_hash) );
+    hash = hash_bytes( hash, &flags, sizeof(flags) );
+    hash = hash_bytes( hash, command, length );
+
+    return hash % N_BUCKETS;
+}
+
+/* Where the cache lives if the user doesn't say: under
+   $XDG_CACHE_HOME, or ~/.cache if that isn't set. Returns NULL if we
+   can't tell. */
+
+char *default_disk_cache_directory( void )
+{
+    char *base = getenv( "XDG_CACHE_HOME" );
+    char *suffix = "/tcshParser";
+    char *directory;
+    size_t length;
+
+    if ( (base == NULL) || (base[0] != '/') ) {
+        base = getenv( "HOME" );
+        suffix = "/.cache/tcshParser";
+        if ( (base == NULL) || (base[0] == '\0') ) {
+            return NULL;
+        }
+    }
+
+    length = strlen( base ) + strlen( suffix );
+    directory = allocate( length + 1 );
+    snprintf( directory, length + 1, "%s%s", base, suffix );
+
+    return directory;
+}
+
+/* Create a directory, and any of its parents which don't exist. */
+
+static int make_directories( char *directory )
+{
+    char *path = strdup( directory );
+    char *p;
+    int status = 0;
+
+    for ( p = path + 1; (status == 0) && (*p != '\0'); p++ ) {
+        if ( *p == '/' ) {
+            *p = '\0';
+            if ( (mkdir( path, 0700 ) != 0) && (errno != EEXIST) ) {
+                status = -1;
+            }
+            *p = '/';
+        }
+    }
+
+    if ( (status == 0) && (mkdir( path, 0700 ) != 0) && (errno != EEXIST) ) {
+        status = -1;
+    }
+
+    free( path );
+    return status;
+}
+
+/* Open the cache in a directory, creating the directory if need be.
+   The file itself isn't created until something is stored in it.
+   Returns NULL, with a warning, if the directory can't be created. */
+
+DiskCache *open_disk_cache( char *directory )
+{
+    DiskCache *cache;
+    struct stat st;
+    CacheFileHeader *header;
+
+    if ( make_directories( directory ) != 0 ) {
+        warn( "Unable to create cache directory %s", directory );
+        return NULL;
+    }
+
+    cache = calloc( 1, sizeof(DiskCache) );
+    if ( asprintf( &(cache->path), "%s/%s", directory, CACHE_FILE ) < 0 ) {
+        free( cache );
+        return NULL;
+    }
+
+    cache->fd = open( cache->path, O_RDONLY );
+    if ( (cache->fd < 0) || (fstat( cache->fd, &st ) != 0) ||
+         (st.st_size < sizeof(CacheFileHeader)) ) {
+        return cache;
+    }
+
+    cache->map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, cache->fd, 0 );
+    if ( cache->map == MAP_FAILED ) {
+        cache->map = NULL;
+        return cache;
+    }
+    cache->map_size = st.st_size;
+
+    header = (CacheFileHeader *) cache->map;
+    if ( (memcmp( header->magic, CACHE_MAGIC, CACHE_MAGIC_LENGTH ) != 0) ||
+         (header->version != CACHE_VERSION) || (header->n_buckets != N_BUCKETS) ) {
+        munmap( cache->map, cache->map_size );
+        cache->map = NULL;
+        cache->map_size = 0;
+    }
+
+    return cache;
+}
+
+/* Hash the contents of an alias file, without reading the aliases
+   themselves. Returns -1 if the file can't be read. */
+
+int hash_alias_file( char *path, unsigned long long *hash )
+{
+    struct stat st;
+    char *contents;
+    int fd;
+
+    fd = open( path, O_RDONLY );
+    if ( fd < 0 ) {
+        return -1;
+    }
+
+    if ( fstat( fd, &st ) != 0 ) {
+        close( fd );
+        return -1;
+    }
+
+    *hash = HASH_START;
+
+    if ( st.st_size > 0 ) {
+        contents = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( contents == MAP_FAILED ) {
+            close( fd );
+            return -1;
+        }
+        *hash = hash_bytes( *hash, contents, st.st_size );
+        munmap( contents, st.st_size );
+    }
+
+    close( fd );
+    return 0;
+}
+
+/* Look up the expansion of a command. Returns NULL if it isn't in the
+   cache, or else the expanded command, which is part of the cache,
+   and its length. This takes no locks: a writer adding an entry as we
+   look can only link it in once it is complete, and anything added
+   beyond the end of our map is treated as missing. */
+
+const char *find_expansion( DiskCache *cache, unsigned long long file_hash, int flags,
+                            char *command, size_t length, size_t *result_length )
+{
+    CacheFileHeader *header = (CacheFileHeader *) cache->map;
+    CacheRecord *record;
+    unsigned long long offset;
+    unsigned long long limit = cache->map_size;
+
+    if ( header == NULL ) {
+        return NULL;
+    }
+
+    offset = __atomic_load_n( &(header->buckets[bucket_of( file_hash, flags, command, length )]),
+                              __ATOMIC_ACQUIRE );
+
+    while ( (offset >= sizeof(CacheFileHeader)) && (offset < limit) &&
+            (offset % 8 == 0) && (limit - offset >= sizeof(CacheRecord)) ) {
+        record = (CacheRecord *) &(cache->map[offset]);
+
+        if ( limit - offset < RECORD_SIZE( record->command_length, record->result_length ) ) {
+            break;
+        }
+
+        if ( (record->file_hash == file_hash) && (record->flags == flags) &&
+             (record->command_length == length) &&
+             (memcmp( &(cache->map[offset + sizeof(CacheRecord)]), command, length ) == 0) ) {
+            *result_length = record->result_length;
+            return &(cache->map[offset + sizeof(CacheRecord) + length]);
+        }
+
+        /* Chains only ever lead back towards the start of the file,
+           which stops a damaged file from sending us round in
+           circles. */
+
+        limit = offset;
+        offset = record->next;
+    }
+
+    return NULL;
+}
+
+/* Write an empty cache file. */
+
+static int write_header( int fd )
+{
+    CacheFileHeader *header = calloc( 1, sizeof(CacheFileHeader) );
+    int status = 0;
+
+    memcpy( header->magic, CACHE_MAGIC, CACHE_MAGIC_LENGTH );
+    header->version = CACHE_VERSION;
+    header->n_buckets = N_BUCKETS;
+
+    if ( (ftruncate( fd, 0 ) != 0) ||
+         (pwrite( fd, header, sizeof(CacheFileHeader), 0 ) != sizeof(CacheFileHeader)) ) {
+        status = -1;
+    }
+
+    free( header );
+    return status;
+}
+
+/* Replace the cache file with an empty one, which is returned locked.
+   Readers with the old file mapped carry on using it, and writers
+   waiting for the old file's lock notice that it has gone. */
+
+static int replace_cache_file( DiskCache *cache )
+{
+    char *temp_path;
+    int fd;
+
+    if ( asprintf( &temp_path, "%s.%d", cache->path, (int) getpid() ) < 0 ) {
+        return -1;
+    }
+
+    fd = open( temp_path, O_RDWR | O_CREAT | O_TRUNC, 0600 );
+    if ( fd >= 0 ) {
+        if ( (flock( fd, LOCK_EX ) != 0) || (write_header( fd ) != 0) ||
+             (rename( temp_path, cache->path ) != 0) ) {
+            close( fd );
+            unlink( temp_path );
+            fd = -1;
+        }
+    }
+
+    free( temp_path );
+    return fd;
+}
+
+/* Open and lock the cache file, making sure that there is room in it
+   for size more bytes. Returns the file, and its size in *end, or -1
+   if that can't be done. */
+
+static int lock_cache_file( DiskCache *cache, size_t size, off_t *end )
+{
+    struct stat st;
+    struct stat path_st;
+    char magic[CACHE_MAGIC_LENGTH];
+    int fd;
+
+    for ( ;; ) {
+        fd = open( cache->path, O_RDWR | O_CREAT, 0600 );
+        if ( fd < 0 ) {
+            return -1;
+        }
+
+        if ( (flock( fd, LOCK_EX ) != 0) || (fstat( fd, &st ) != 0) ) {
+            close( fd );
+            return -1;
+        }
+
+        /* Someone may have replaced the file while we waited for the
+           lock, in which case we need the new one. */
+
+        if ( (stat( cache->path, &path_st ) != 0) ||
+             (path_st.st_dev != st.st_dev) || (path_st.st_ino != st.st_ino) ) {
+            close( fd );
+            continue;
+        }
+
+        if ( st.st_size == 0 ) {
+            if ( write_header( fd ) != 0 ) {
+                close( fd );
+                return -1;
+            }
+            st.st_size = sizeof(CacheFileHeader);
+        } else if ( (st.st_size < sizeof(CacheFileHeader)) ||
+                    (st.st_size + size > MAX_CACHE_FILE) ||
+                    (pread( fd, magic, CACHE_MAGIC_LENGTH, 0 ) != CACHE_MAGIC_LENGTH) ||
+                    (memcmp( magic, CACHE_MAGIC, CACHE_MAGIC_LENGTH ) != 0) ) {
+            close( fd );
+            fd = replace_cache_file( cache );
+            if ( fd < 0 ) {
+                return -1;
+            }
+            st.st_size = sizeof(CacheFileHeader);
+        }
+
+        *end = st.st_size;
+        return fd;
+    }
+}
+
+/* Add the expansion of a command to the cache. The cache is only ever
+   an optimisation, so if anything goes wrong we quietly give up. */
+
+void store_expansion( DiskCache *cache, unsigned long long file_hash, int flags,
+                      char *command, size_t length, char *result, size_t result_length )
+{
+    size_t size = RECORD_SIZE( length, result_length );
+    CacheFileHeader *header;
+    CacheRecord *record;
+    unsigned int bucket;
+    off_t end;
+    int fd;
+
+    if ( size > MAX_CACHE_FILE - sizeof(CacheFileHeader) ) {
+        return;
+    }
+
+    fd = lock_cache_file( cache, size, &end );
+    if ( fd < 0 ) {
+        return;
+    }
+
+    header = mmap( NULL, sizeof(CacheFileHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( header == MAP_FAILED ) {
+        close( fd );
+        return;
+    }
+
+    bucket = bucket_of( file_hash, flags, command, length );
+
+    record = calloc( 1, size );
+    record->next = header->buckets[bucket];
+    record->file_hash = file_hash;
+    record->flags = flags;
+    record->command_length = length;
+    record->result_length = result_length;
+    memcpy( (char *) record + sizeof(CacheRecord), command, length );
+    memcpy( (char *) record + sizeof(CacheRecord) + length, result, result_length );
+
+    /* Only link the entry in once the whole of it is in the file. */
+
+    if ( pwrite( fd, record, size, end ) == size ) {
+        __atomic_store_n( &(header->buckets[bucket]), (unsigned long long) end,
+                          __ATOMIC_RELEASE );
+    }
+
+    free( record );
+    munmap( header, sizeof(CacheFileHeader) );
+    close( fd );
+}
+
+void close_disk_cache( DiskCache *cache )
+{
+    if ( cache->map != NULL ) {
+        munmap( cache->map, cache->map_size );
+    }
+    if ( cache->fd >= 0 ) {
+        close( cache->fd );
+    }
+    free( cache->path );
+    free( cache );
+}
@@ -0,0 +1,62 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __DISK_CACHE_SUPPORT_H__
+#define __DISK_CACHE_SUPPORT_H__
+
+#include <stddef.h>
+
+/* A cache of expanded commands kept on disk, so that running the
+   program over and over with the same alias file and command only
+   expands the command once. Entries are keyed on a hash of the
+   contents of the alias file, the EXPAND_ flags and the command.
+
+   The cache is a single file, which is a fixed table of buckets
+   followed by the entries, each of which is appended to the end of
+   the file and then linked onto the front of its bucket's chain.
+   Writers take it in turns, using flock(), but readers just map the
+   file and follow the chains, without any locking at all. An entry is
+   only linked in once all of it has been written, so a reader sees
+   either the whole of an entry or none of it. When the file gets too
+   big it is replaced by an empty one, which readers still using the
+   old file never notice. */
+
+typedef struct disk_cache {
+    char *path;
+    int fd;
+    char *map;
+    size_t map_size;
+} DiskCache;
+
+char *default_disk_cache_directory( void );
+
+DiskCache *open_disk_cache( char *directory );
+
+int hash_alias_file( char *path, unsigned long long *hash );
+
+const char *find_expansion( DiskCache *cache, unsigned long long file_hash, int flags,
+                            char *command, size_t length, size_t *result_length );
+
+void store_expansion( DiskCache *cache, unsigned long long file_hash, int flags,
+                      char *command, size_t length, char *result, size_t result_length );
+
+void close_disk_cache( DiskCache *cache );
+
+
+#endif /* __DISK_CACHE_SUPPORT_H__ */
@@ -0,0 +1,153 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+
+#include "emit_support.h"
+#include "alias_support.h"
+
+/* Write the characters as the contents of a C string literal. The
+   '\0' after each name and value is written as an octal escape, and
+   starts a new line. Every character that isn't printable, and '?',
+   which could begin a trigraph, is escaped too. */
+
+static void emit_string( FILE *f, const char *s, size_t length )
+{
+    size_t i;
+    int column = 0;
+
+    fprintf( f, "    \"" );
+    for ( i = 0; i < length; i++ ) {
+        if ( (s[i] == '"') || (s[i] == '\\') ) {
+            column += fprintf( f, "\\%c", s[i] );
+        } else if ( (s[i] >= ' ') && (s[i] <= '~') && (s[i] != '?') ) {
+            column += fprintf( f, "%c", s[i] );
+        } else {
+            column += fprintf( f, "\\%03o", (unsigned char) s[i] );
+        }
+
+        if ( ((s[i] == '\0') || (column >= 72)) && (i + 1 < length) ) {
+            fprintf( f, "\"\n    \"" );
+            column = 0;
+        }
+    }
+    fprintf( f, "\"" );
+}
+
+/* Write an array of n numbers, or a single zero if there are none,
+   since C has no empty arrays. */
+
+static void emit_numbers( FILE *f, const char *type, const char *name,
+                          const void *numbers, int is_signed, size_t n )
+{
+    size_t i;
+
+    fprintf( f, "\nstatic const %s %s[] = {", type, name );
+    for ( i = 0; i < n; i++ ) {
+        fprintf( f, "%s", (i % 8 == 0) ? "\n    " : " " );
+        if ( is_signed ) {
+            fprintf( f, "%d,", ((const int *) numbers)[i] );
+        } else {
+            fprintf( f, "%uu,", ((const unsigned int *) numbers)[i] );
+        }
+    }
+    fprintf( f, "%s\n};\n", (n == 0) ? "\n    0" : "" );
+}
+
+/* Write out a table, building its perfect hash first. The table is
+   given the name builtin_aliases. Returns -1 if no perfect hash could
+   be found, or the file couldn't be written. */
+
+int emit_alias_table( AliasTable *table, const char *alias_file, FILE *f )
+{
+    unsigned int i;
+
+    if ( build_perfect_hash( table ) < 0 ) {
+        fprintf( stderr, "Unable to build a perfect hash over the aliases in %s\n", alias_file );
+        return -1;
+    }
+
+    fprintf( f, "/* The aliases in %s, compiled into the program. Generated by\n"
+                "   \"tcshParser -emit-c\", so don't edit it. */\n\n", alias_file );
+    fprintf( f, "#include \"alias_support.h\"\n" );
+
+    fprintf( f, "\nstatic const char pool[] =\n" );
+    emit_string( f, table->pool, table->pool_used );
+    fprintf( f, ";\n" );
+
+    emit_numbers( f, "unsigned int", "lhs_offset", table->lhs_offset, 0, table->n_aliases );
+    emit_numbers( f, "unsigned int", "lhs_length", table->lhs_length, 0, table->n_aliases );
+    emit_numbers( f, "unsigned int", "rhs_offset", table->rhs_offset, 0, table->n_aliases );
+    emit_numbers( f, "unsigned int", "rhs_length", table->rhs_length, 0, table->n_aliases );
+    emit_numbers( f, "unsigned int", "hash", table->hash, 0, table->n_aliases );
+
+    fprintf( f, "\nstatic const HistoryPart history[] = {\n" );
+    for ( i = 0; i < table->n_history; i++ ) {
+        fprintf( f, "    { %u, %u, %d, %d, %d },\n", table->history[i].text_start,
+                 table->history[i].text_length, table->history[i].first,
+                 table->history[i].last, table->history[i].flags );
+    }
+    fprintf( f, "%s};\n", (table->n_history == 0) ? "    { 0, 0, 0, 0, 0 }\n" : "" );
+
+    fprintf( f, "\nstatic const unsigned char filter[] = {" );
+    for ( i = 0; i <= table->filter_mask / 8; i++ ) {
+        fprintf( f, "%s%u,", (i % 12 == 0) ? "\n    " : " ", table->filter[i] );
+    }
+    fprintf( f, "\n};\n" );
+
+    emit_numbers( f, "unsigned int", "history_start", table->history_start, 0, table->n_aliases );
+    emit_numbers( f, "unsigned int", "history_count", table->history_count, 0, table->n_aliases );
+    emit_numbers( f, "unsigned int", "perfect_seeds", table->perfect_seeds, 0,
+                  table->n_perfect_seeds );
+    emit_numbers( f, "int", "perfect_slots", table->perfect_slots, 1, table->n_perfect_slots );
+
+    fprintf( f, "\nAliasTable builtin_aliases = {\n" );
+    fprintf( f, "    .pool = (char *) pool,\n" );
+    fprintf( f, "    .pool_used = %zu,\n", table->pool_used );
+    fprintf( f, "    .pool_size = %zu,\n", table->pool_used );
+    fprintf( f, "    .n_aliases = %d,\n", table->n_aliases );
+    fprintf( f, "    .max_aliases = %d,\n", table->n_aliases );
+    fprintf( f, "    .lhs_offset = (unsigned int *) lhs_offset,\n" );
+    fprintf( f, "    .lhs_length = (unsigned int *) lhs_length,\n" );
+    fprintf( f, "    .rhs_offset = (unsigned int *) rhs_offset,\n" );
+    fprintf( f, "    .rhs_length = (unsigned int *) rhs_length,\n" );
+    fprintf( f, "    .hash = (unsigned int *) hash,\n" );
+
+    fprintf( f, "    .filter = (unsigned char *) filter,\n" );
+    fprintf( f, "    .filter_mask = %u,\n", table->filter_mask );
+
+    fprintf( f, "    .history = (HistoryPart *) history,\n" );
+    fprintf( f, "    .n_history = %u,\n", table->n_history );
+    fprintf( f, "    .history_start = (unsigned int *) history_start,\n" );
+    fprintf( f, "    .history_count = (unsigned int *) history_count,\n" );
+    fprintf( f, "    .perfect_seeds = (unsigned int *) perfect_seeds,\n" );
+    fprintf( f, "    .n_perfect_seeds = %u,\n", table->n_perfect_seeds );
+    fprintf( f, "    .perfect_slots = (int *) perfect_slots,\n" );
+    fprintf( f, "    .n_perfect_slots = %u,\n", table->n_perfect_slots );
+    fprintf( f, "    .is_static = 1\n" );
+    fprintf( f, "};\n" );
+
+    if ( fflush( f ) != 0 ) {
+        perror( "Unable to write the alias table" );
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __EMIT_SUPPORT_H__
+#define __EMIT_SUPPORT_H__
+
+#include <stdio.h>
+
+#include "alias_support.h"
+
+/* For a fixed set of aliases, used across a whole site, the table can
+   be compiled into the program instead of being read from a file
+   every time. emit_alias_table() writes a C source file defining the
+   AliasTable builtin_aliases, with a perfect hash over the names (see
+   alias_support.h) and the aliases' templates already built. All the
+   arrays are const, so they go into the program's read-only data, cost
+   nothing to load, and are shared through the page cache by every
+   process running the program. Only the AliasTable itself, with its
+   counters, is writable. The table is built into tcshParser-site by
+   "make tcshParser-site SITE_ALIASES=<alias-file>", and then used by
+   giving "-builtin" in place of the alias file. */
+
+int emit_alias_table( AliasTable *table, const char *alias_file, FILE *f );
+
+
+#endif /* __EMIT_SUPPORT_H__ */
@@ -0,0 +1,233 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "history_support.h"
+#include "allocator_support.h"
+
+/* The number of digits at the start of a string. */
+
+static int count_digits( const char *string )
+{
+    int i = 0;
+
+    while ( isdigit( string[i] ) ) {
+        i++;
+    }
+
+    return i;
+}
+
+static void add_part( HistoryPart **parts, int *n_parts, int start, int length,
+                      int first, int last, int flags )
+{
+    HistoryPart *part;
+
+    *parts = reallocate( *parts, (*n_parts + 1) * sizeof(HistoryPart) );
+    part = &((*parts)[(*n_parts)++]);
+    part->text_start = start;
+    part->text_length = length;
+    part->first = first;
+    part->last = last;
+    part->flags = flags;
+}
+
+/* Parse an alias's value into a template, which is returned in *parts
+   and should be freed with deallocate(). Returns the number of parts,
+   which is zero for an empty value. Where the words of a range are
+   counted back from the number of arguments, n, first and last are
+   added to n, so "!$" is the range n+0 to n+0, and "!:2-" is 2 to
+   n-1. */
+
+int parse_history( const char *value, HistoryPart **parts )
+{
+    int start_index = 0;
+    int curr_index = 0;
+    int length = strlen( value );
+    int n_parts = 0;
+    int digits;
+
+    *parts = NULL;
+
+    /* We are looking for patterns which start with a '!'. The '!' is
+       always followed by one or more characters, so there is no point
+       in looking past the penultimate character. */
+
+    while ( curr_index < (length - 1) ) {
+        if ( value[curr_index] == '!' ) {
+            int n = 0;
+            int m = 0;
+            int flags = HISTORY_WORDS;
+            int pattern_size = 0;
+            int found_colon = 0;
+
+            curr_index++;
+            if ( value[curr_index] == ':' ) {
+                curr_index++;
+                found_colon = 1;
+            }
+
+            switch ( value[curr_index] ) {
+            case '!':
+            case '#':
+                /* "!!" means the previous event while "!#" means the
+                   current event, but for our purposes the two are
+                   equivalent. */
+                flags |= HISTORY_LAST_FROM_END;
+                pattern_size = 1;
+                break;
+
+            case '*': /* "!*" means all the arguments, but returns nothing if there are no args. */
+                n = 1;
+                flags |= HISTORY_LAST_FROM_END;
+                pattern_size = 1;
+                break;
+
+            case '$': /* "!$" means the final argument */
+                flags |= HISTORY_FIRST_FROM_END | HISTORY_LAST_FROM_END;
+                pattern_size = 1;
+                break;
+
+            case '^': /* "!^" means the first argument */
+                n = 1;
+
+                /* If the next character is '-', then we have a range
+                   starting with the first arg. */
+
+                if ( value[curr_index + 1] == '-' ) {
+                    digits = count_digits( &(value[curr_index + 2]) );
+                    if ( digits > 0 ) { /* "!:^-m" */
+                        pattern_size = digits + 2;
+                        m = atoi( &(value[curr_index + 2]) );
+                    } else if ( value[curr_index + 2] == '$' ) {
+                        pattern_size = 3;
+                        flags |= HISTORY_LAST_FROM_END;
+                    } else {
+                        /* A "!:^-" without a following number implies all
+                           args but last, equivalent to "!:1-" */
+                        pattern_size = 2;
+                        m = -1;
+                        flags |= HISTORY_LAST_FROM_END;
+                    }
+                } else {
+                    pattern_size = 1;
+                    m = 1;
+                }
+                break;
+
+            case '-':
+                /* If a "range" starts with a '-', then the range
+                   implicitly starts at zero. */
+                digits = count_digits( &(value[curr_index + 1]) );
+                if ( digits > 0 ) {
+                    pattern_size = digits + 1;
+                    m = atoi( &(value[curr_index + 1]) );
+                } else if ( value[curr_index + 1] == '$' ) {
+                    /* "!:-$" implies all */
+                    pattern_size = 2;
+                    flags |= HISTORY_LAST_FROM_END;
+                } else {
+                    /* "!:-" implies all but last, equivalent to "!:0-" */
+                    pattern_size = 1;
+                    m = -1;
+                    flags |= HISTORY_LAST_FROM_END;
+                }
+                break;
+
+            default:
+                if ( found_colon ) {
+                    digits = count_digits( &(value[curr_index]) );
+                    if ( digits > 0 ) {
+                        /* found "!:n... " */
+                        pattern_size = digits;
+                        n = atoi( &(value[curr_index]) );
+
+                        switch ( value[curr_index + pattern_size] ) {
+                        case '*': /* Equivalent to !:n-$ */
+                            flags |= HISTORY_LAST_FROM_END;
+                            pattern_size++;
+                            break;
+
+                        case '-':
+                            pattern_size++;
+                            digits = count_digits( &(value[curr_index + pattern_size]) );
+                            if ( digits > 0 ) {
+                                /* "!:n-m" */
+                                m = atoi( &(value[curr_index + pattern_size]) );
+                                pattern_size += digits;
+                            } else if ( value[curr_index + pattern_size] == '$' ) {
+                                flags |= HISTORY_LAST_FROM_END;
+                                pattern_size++;
+                            } else {
+                                /* "!:n-" implies all but last */
+                                m = -1;
+                                flags |= HISTORY_LAST_FROM_END;
+                            }
+                            break;
+
+                        default:
+                            /* just "!:n" */
+                            m = n;
+                            break;
+                        }
+                    } else {
+                        /* "!:" is the same as "!#" */
+                        flags |= HISTORY_LAST_FROM_END;
+                        pattern_size = 1;
+                    }
+                }
+                break;
+            }
+
+            if ( pattern_size != 0 ) {
+                add_part( parts, &n_parts, start_index,
+                          curr_index - start_index - (found_colon ? 2 : 1), n, m, flags );
+                curr_index += pattern_size;
+                start_index = curr_index;
+            }
+        } else {
+            curr_index++;
+        }
+    }
+
+    if ( start_index < length ) {
+        add_part( parts, &n_parts, start_index, length - start_index, 0, 0, 0 );
+    }
+
+    return n_parts;
+}
+
+/* Returns non-zero if a template refers to the history at all. If it
+   doesn't, the arguments are simply appended to the alias's value. */
+
+int uses_history( const HistoryPart *parts, int n_parts )
+{
+    int i;
+
+    for ( i = 0; i < n_parts; i++ ) {
+        if ( parts[i].flags & HISTORY_WORDS ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HISTORY_SUPPORT_H__
+#define __HISTORY_SUPPORT_H__
+
+/* An alias can refer to the "history", meaning the command which used
+   it, with patterns like "!*", "!$" or "!:2-3", each of which picks
+   out a range of its words, where word zero is the alias's name. The
+   patterns in an alias's value don't depend on the command using it,
+   so the value is parsed once, into a template: a list of parts, each
+   some literal text from the value, usually followed by a range of
+   words. An end of a range that depends on the number of arguments,
+   like the one in "!$", is counted back from that number. */
+
+#define HISTORY_WORDS 1
+#define HISTORY_FIRST_FROM_END 2
+#define HISTORY_LAST_FROM_END 4
+
+typedef struct history_part {
+    unsigned int text_start;
+    unsigned int text_length;
+    int first;
+    int last;
+    int flags;
+} HistoryPart;
+
+int parse_history( const char *value, HistoryPart **parts );
+
+int uses_history( const HistoryPart *parts, int n_parts );
+
+
+#endif /* __HISTORY_SUPPORT_H__ */
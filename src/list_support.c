@@ -25,6 +25,7 @@
 #include <ctype.h>
 
 #include "list_support.h"
+#include "allocator_support.h"
 
 /* Returns the number of items in the list. */
 
@@ -56,7 +57,7 @@ char *get_nth_word( List *list, int n )
         word = "";
     }
 
-    return strdup( word );
+    return copy_string( word );
 }
 
 /* Create an entry for "value" and append it to an existing "list". */
@@ -64,9 +65,9 @@ char *get_nth_word( List *list, int n )
 List *append_to_list( List *list, char *value )
 {
     List *entry;
-    List *result;
+    List *result = list;
 
-    entry = malloc( sizeof( List ) );
+    entry = allocate( sizeof( List ) );
     if ( entry != NULL ) {
         entry->next = NULL;
         entry->contents = value;
@@ -94,13 +95,13 @@ void free_list( List *list )
 
     while ( list != NULL ) {
         if ( list->contents != NULL ) {
-            free( list->contents );
+            deallocate( list->contents );
         }
 
         entry = list;
         list = list->next;
 
-        free( entry );
+        deallocate( entry );
     }
 }
 
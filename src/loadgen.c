@@ -0,0 +1,299 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Load generator for a tcshParser server. Opens a number of concurrent
+   connections, each of which sends requests one at a time, and reports
+   the distribution of the time taken for each response.
+
+       loadgen <socket> <alias-file> [clients] [requests-per-client]
+
+   Alternatively, with "-pipeline", compare the throughput of a single
+   binary protocol connection sending requests one at a time, with the
+   same connection keeping up to <depth> requests outstanding.
+
+       loadgen -pipeline <depth> <socket> <alias-file> [requests]
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#include "server_support.h"
+#include "client_support.h"
+#include "allocator_support.h"
+
+#define MAX_EVENTS 256
+
+/* The requests cycle through these commands: some aliases, and some
+   not. */
+
+static char *commands[] = {
+    "ls -l",
+    "ll /tmp",
+    "make all",
+    "twice one two",
+    "cd /tmp ; lnd",
+    "gcc -O2 -c foo.c -o foo.o",
+};
+
+#define N_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+typedef struct client {
+    int fd;
+    int sent;
+    int received;
+    double start;
+    char buffer[4096];
+    size_t used;
+} Client;
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles( const void *a, const void *b )
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void send_request( Client *client, char *alias_file )
+{
+    char request[4096];
+    int length;
+
+    length = snprintf( request, sizeof(request), "%s\t%s\n", alias_file,
+                       commands[(client->fd + client->sent) % N_COMMANDS] );
+
+    /* Requests are small, so the socket buffer always has room. */
+    if ( write( client->fd, request, length ) != length ) {
+        err( 1, "Unable to send request" );
+    }
+
+    client->sent++;
+    client->start = now();
+}
+
+/* Send n_requests requests, keeping up to depth of them outstanding.
+   Returns the number of requests per second. */
+
+static double run_pipeline( char *address, char *alias_file, int n_requests, int depth )
+{
+    ExpansionClient *client;
+    unsigned int id;
+    char *result;
+    size_t length;
+    int is_error;
+    int sent = 0;
+    int received = 0;
+    double start;
+
+    client = open_expansion_client( address );
+    if ( client == NULL ) {
+        exit( 1 );
+    }
+
+    start = now();
+
+    while ( received < n_requests ) {
+        while ( (sent < n_requests) && (sent - received < depth) ) {
+            queue_expansion( client, alias_file, commands[sent % N_COMMANDS],
+                             strlen( commands[sent % N_COMMANDS] ), 0 );
+            sent++;
+        }
+
+        if ( send_expansions( client ) < 0 ) {
+            errx( 1, "Unable to send requests" );
+        }
+
+        /* Wait for at least one response, and then for as many more as
+           we can, so that the window refills in batches. */
+
+        do {
+            if ( receive_expansion( client, &id, &result, &length, &is_error ) < 0 ) {
+                errx( 1, "Server closed the connection" );
+            }
+            deallocate( result );
+            received++;
+        } while ( (received < sent) &&
+                  (client->in_used - client->in_start >= FRAME_HEADER_SIZE) );
+    }
+
+    close_expansion_client( client );
+
+    return n_requests / (now() - start);
+}
+
+static int compare_pipelines( int argc, char *argv[] )
+{
+    char *alias_file;
+    int depth;
+    int n_requests = 100000;
+    double serial;
+    double pipelined;
+
+    if ( argc < 5 ) {
+        fprintf( stderr, "usage: %s -pipeline <depth> <socket> <alias-file> [requests]\n", argv[0] );
+        return 1;
+    }
+
+    depth = atoi( argv[2] );
+    alias_file = realpath( argv[4], NULL );
+    if ( alias_file == NULL ) {
+        err( 1, "Unable to open file %s", argv[4] );
+    }
+
+    if ( argc > 5 ) {
+        n_requests = atoi( argv[5] );
+    }
+
+    serial = run_pipeline( argv[3], alias_file, n_requests, 1 );
+    pipelined = run_pipeline( argv[3], alias_file, n_requests, depth );
+
+    printf( "%d requests on one connection\n", n_requests );
+    printf( "One at a time: %.0f requests/s\n", serial );
+    printf( "Pipelined, depth %d: %.0f requests/s (%.1fx)\n", depth, pipelined,
+            pipelined / serial );
+
+    return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event;
+    Client *clients;
+    Client *client;
+    double *latencies;
+    int n_latencies = 0;
+    int n_clients = 100;
+    int n_requests = 100;
+    int n_finished = 0;
+    int epoll_fd;
+    char *alias_file;
+    char *newline;
+    double start;
+    double elapsed;
+    ssize_t n;
+    int n_events;
+    int i;
+
+    if ( (argc > 1) && (strcmp( argv[1], "-pipeline" ) == 0) ) {
+        return compare_pipelines( argc, argv );
+    }
+
+    if ( argc < 3 ) {
+        fprintf( stderr, "usage: %s <socket> <alias-file> [clients] [requests-per-client]\n", argv[0] );
+        fprintf( stderr, "       %s -pipeline <depth> <socket> <alias-file> [requests]\n", argv[0] );
+        return 1;
+    }
+
+    alias_file = realpath( argv[2], NULL );
+    if ( alias_file == NULL ) {
+        err( 1, "Unable to open file %s", argv[2] );
+    }
+
+    if ( argc > 3 ) {
+        n_clients = atoi( argv[3] );
+    }
+    if ( argc > 4 ) {
+        n_requests = atoi( argv[4] );
+    }
+
+    clients = calloc( n_clients, sizeof(Client) );
+    latencies = malloc( (size_t) n_clients * n_requests * sizeof(double) );
+    epoll_fd = epoll_create1( 0 );
+
+    for ( i = 0; i < n_clients; i++ ) {
+        clients[i].fd = connect_to_server( argv[1] );
+        if ( clients[i].fd < 0 ) {
+            return 1;
+        }
+        fcntl( clients[i].fd, F_SETFL, O_NONBLOCK );
+
+        event.events = EPOLLIN;
+        event.data.ptr = &(clients[i]);
+        epoll_ctl( epoll_fd, EPOLL_CTL_ADD, clients[i].fd, &event );
+    }
+
+    start = now();
+    for ( i = 0; i < n_clients; i++ ) {
+        send_request( &(clients[i]), alias_file );
+    }
+
+    while ( n_finished < n_clients ) {
+        n_events = epoll_wait( epoll_fd, events, MAX_EVENTS, -1 );
+
+        for ( i = 0; i < n_events; i++ ) {
+            client = events[i].data.ptr;
+
+            n = read( client->fd, &(client->buffer[client->used]),
+                      sizeof(client->buffer) - client->used );
+            if ( n <= 0 ) {
+                if ( (n < 0) && (errno == EAGAIN) ) {
+                    continue;
+                }
+                errx( 1, "Server closed the connection" );
+            }
+            client->used += n;
+
+            /* Each complete line is the response to the one request we
+               have outstanding. */
+
+            while ( (newline = memchr( client->buffer, '\n', client->used )) != NULL ) {
+                latencies[n_latencies++] = now() - client->start;
+                client->received++;
+
+                client->used -= (newline + 1) - client->buffer;
+                memmove( client->buffer, newline + 1, client->used );
+
+                if ( client->received < n_requests ) {
+                    send_request( client, alias_file );
+                } else {
+                    n_finished++;
+                }
+            }
+        }
+    }
+
+    elapsed = now() - start;
+
+    qsort( latencies, n_latencies, sizeof(double), compare_doubles );
+
+    printf( "%d clients, %d requests in %.3f s (%.0f requests/s)\n",
+            n_clients, n_latencies, elapsed, n_latencies / elapsed );
+    printf( "Latency p50: %.1f us  p99: %.1f us  max: %.1f us\n",
+            latencies[n_latencies / 2] * 1e6,
+            latencies[(int) (n_latencies * 0.99)] * 1e6,
+            latencies[n_latencies - 1] * 1e6 );
+
+    return 0;
+}
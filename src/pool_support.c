@@ -0,0 +1,193 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool_support.h"
+
+/* Start the next task of the first group with any left to start,
+   returning its group and setting its index, or return NULL if there
+   are none. A group is taken off the list once all its tasks have
+   been started. Must be called with the lock held. */
+
+static TaskGroup *start_task( ThreadPool *pool, int *index )
+{
+    TaskGroup *group = pool->groups;
+
+    if ( group == NULL ) {
+        return NULL;
+    }
+
+    *index = group->n_started++;
+    if ( group->n_started == group->n_tasks ) {
+        pool->groups = group->next;
+    }
+
+    return group;
+}
+
+/* Run a task which has been started, with the lock held on entry and
+   on exit, but not while the task runs. */
+
+static void run_task( ThreadPool *pool, TaskGroup *group, int index )
+{
+    pthread_mutex_unlock( &(pool->lock) );
+    group->task( group->arguments[index] );
+    pthread_mutex_lock( &(pool->lock) );
+
+    if ( ++(group->n_finished) == group->n_tasks ) {
+        pthread_cond_broadcast( &(pool->finished) );
+    }
+}
+
+static void *work( void *argument )
+{
+    ThreadPool *pool = argument;
+    TaskGroup *group;
+    int index;
+
+    pthread_mutex_lock( &(pool->lock) );
+
+    for ( ;; ) {
+        group = start_task( pool, &index );
+        if ( group != NULL ) {
+            run_task( pool, group, index );
+        } else if ( pool->stopping ) {
+            break;
+        } else {
+            pthread_cond_wait( &(pool->work), &(pool->lock) );
+        }
+    }
+
+    pthread_mutex_unlock( &(pool->lock) );
+
+    return NULL;
+}
+
+/* Start a pool of n_threads workers, or if n_threads is negative, one
+   fewer than there are processors, as whoever hands over the tasks
+   will be running them as well. A pool with no workers at all simply
+   runs every task in the thread which hands it over. */
+
+ThreadPool *new_thread_pool( int n_threads )
+{
+    ThreadPool *pool = calloc( 1, sizeof(ThreadPool) );
+    int i;
+
+    if ( n_threads < 0 ) {
+        n_threads = sysconf( _SC_NPROCESSORS_ONLN ) - 1;
+        if ( n_threads < 0 ) {
+            n_threads = 0;
+        }
+    }
+
+    pthread_mutex_init( &(pool->lock), NULL );
+    pthread_cond_init( &(pool->work), NULL );
+    pthread_cond_init( &(pool->finished), NULL );
+
+    pool->threads = calloc( n_threads + 1, sizeof(pthread_t) );
+    for ( i = 0; i < n_threads; i++ ) {
+        if ( pthread_create( &(pool->threads[pool->n_threads]), NULL, work, pool ) == 0 ) {
+            pool->n_threads++;
+        }
+    }
+
+    return pool;
+}
+
+/* Stop the workers, once they have finished any tasks they are
+   running, and free the pool. */
+
+void free_thread_pool( ThreadPool *pool )
+{
+    int i;
+
+    if ( pool == NULL ) {
+        return;
+    }
+
+    pthread_mutex_lock( &(pool->lock) );
+    pool->stopping = 1;
+    pthread_cond_broadcast( &(pool->work) );
+    pthread_mutex_unlock( &(pool->lock) );
+
+    for ( i = 0; i < pool->n_threads; i++ ) {
+        pthread_join( pool->threads[i], NULL );
+    }
+
+    pthread_cond_destroy( &(pool->finished) );
+    pthread_cond_destroy( &(pool->work) );
+    pthread_mutex_destroy( &(pool->lock) );
+    free( pool->threads );
+    free( pool );
+}
+
+/* Call task once for each of the n_tasks arguments, using the pool's
+   workers as well as this thread, and return once they have all
+   finished. */
+
+void run_tasks( ThreadPool *pool, PoolTask task, void **arguments, int n_tasks )
+{
+    TaskGroup group;
+    TaskGroup **last;
+    int i;
+
+    if ( (pool == NULL) || (pool->n_threads == 0) || (n_tasks < 2) ) {
+        for ( i = 0; i < n_tasks; i++ ) {
+            task( arguments[i] );
+        }
+        return;
+    }
+
+    group.task = task;
+    group.arguments = arguments;
+    group.n_tasks = n_tasks;
+    group.n_started = 0;
+    group.n_finished = 0;
+    group.next = NULL;
+
+    pthread_mutex_lock( &(pool->lock) );
+
+    for ( last = &(pool->groups); *last != NULL; last = &((*last)->next) ) {
+    }
+    *last = &group;
+    pthread_cond_broadcast( &(pool->work) );
+
+    /* Run our own tasks, rather than any which are waiting ahead of
+       them, as another thread may be waiting for us. */
+
+    while ( group.n_started < group.n_tasks ) {
+        i = group.n_started++;
+        if ( group.n_started == group.n_tasks ) {
+            for ( last = &(pool->groups); *last != &group; last = &((*last)->next) ) {
+            }
+            *last = group.next;
+        }
+        run_task( pool, &group, i );
+    }
+
+    while ( group.n_finished < group.n_tasks ) {
+        pthread_cond_wait( &(pool->finished), &(pool->lock) );
+    }
+
+    pthread_mutex_unlock( &(pool->lock) );
+}
@@ -0,0 +1,59 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __POOL_SUPPORT_H__
+#define __POOL_SUPPORT_H__
+
+#include <pthread.h>
+
+/* A fixed set of worker threads, which run groups of independent
+   tasks. Whoever hands over a group runs its tasks too, alongside the
+   workers, and only waits for the tasks which have already been
+   started, so a group can safely be handed over from within a task,
+   or by several threads at once. Tasks are expected to be fairly
+   large, so a single lock is enough. */
+
+typedef void (*PoolTask)( void *argument );
+
+typedef struct task_group {
+    PoolTask task;
+    void **arguments;
+    int n_tasks;
+    int n_started;
+    int n_finished;
+    struct task_group *next;
+} TaskGroup;
+
+typedef struct thread_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t finished;
+    TaskGroup *groups;
+    pthread_t *threads;
+    int n_threads;
+    int stopping;
+} ThreadPool;
+
+ThreadPool *new_thread_pool( int n_threads );
+
+void free_thread_pool( ThreadPool *pool );
+
+void run_tasks( ThreadPool *pool, PoolTask task, void **arguments, int n_tasks );
+
+
+#endif /* __POOL_SUPPORT_H__ */
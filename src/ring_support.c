@@ -0,0 +1,165 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ring_support.h"
+
+/* How many times ring_put() and ring_get() yield, in case the other
+   thread is about to catch up, before they go to sleep. */
+
+#define RING_SPINS 64
+
+static void futex_wait( unsigned int *word, unsigned int value )
+{
+    syscall( SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0 );
+}
+
+static void futex_wake( unsigned int *word )
+{
+    syscall( SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0 );
+}
+
+/* Create a ring which can hold "size" items, rounded up to a power of
+   two. */
+
+Ring *new_ring( unsigned int size )
+{
+    Ring *ring = calloc( 1, sizeof(Ring) );
+    unsigned int capacity = 1;
+
+    while ( capacity < size ) {
+        capacity <<= 1;
+    }
+
+    ring->slots = calloc( capacity, sizeof(void *) );
+    ring->mask = capacity - 1;
+
+    return ring;
+}
+
+void free_ring( Ring *ring )
+{
+    if ( ring != NULL ) {
+        free( ring->slots );
+        free( ring );
+    }
+}
+
+/* Add an item to the ring, waking the consumer if it is waiting for
+   one. Returns zero if the ring is full. Only the producer may call
+   this. The new tail must be seen before the consumer's flag is
+   looked at, just as the consumer sets the flag before it looks at the
+   tail, so one of the two always sees the other. */
+
+int ring_push( Ring *ring, void *item )
+{
+    unsigned int tail = ring->tail;
+    unsigned int head = __atomic_load_n( &(ring->head), __ATOMIC_ACQUIRE );
+
+    if ( tail - head > ring->mask ) {
+        return 0;
+    }
+
+    ring->slots[tail & ring->mask] = item;
+    __atomic_store_n( &(ring->tail), tail + 1, __ATOMIC_SEQ_CST );
+
+    if ( __atomic_load_n( &(ring->consumer_waiting), __ATOMIC_SEQ_CST ) ) {
+        futex_wake( &(ring->tail) );
+    }
+
+    return 1;
+}
+
+/* Take the oldest item from the ring, waking the producer if it is
+   waiting for room. Returns zero if the ring is empty. Only the
+   consumer may call this. */
+
+int ring_pop( Ring *ring, void **item )
+{
+    unsigned int head = ring->head;
+    unsigned int tail = __atomic_load_n( &(ring->tail), __ATOMIC_ACQUIRE );
+
+    if ( head == tail ) {
+        return 0;
+    }
+
+    *item = ring->slots[head & ring->mask];
+    __atomic_store_n( &(ring->head), head + 1, __ATOMIC_SEQ_CST );
+
+    if ( __atomic_load_n( &(ring->producer_waiting), __ATOMIC_SEQ_CST ) ) {
+        futex_wake( &(ring->head) );
+    }
+
+    return 1;
+}
+
+/* Blocking versions of ring_push() and ring_pop(), which wait for the
+   other thread to catch up: briefly by yielding, and then by sleeping
+   until the index the other thread moves has changed. */
+
+void ring_put( Ring *ring, void *item )
+{
+    unsigned int head;
+    int spins = 0;
+
+    while ( !ring_push( ring, item ) ) {
+        if ( spins < RING_SPINS ) {
+            spins++;
+            sched_yield();
+            continue;
+        }
+
+        __atomic_store_n( &(ring->producer_waiting), 1, __ATOMIC_SEQ_CST );
+        head = __atomic_load_n( &(ring->head), __ATOMIC_SEQ_CST );
+        if ( ring->tail - head > ring->mask ) {
+            futex_wait( &(ring->head), head );
+        }
+        __atomic_store_n( &(ring->producer_waiting), 0, __ATOMIC_RELAXED );
+    }
+}
+
+void *ring_get( Ring *ring )
+{
+    unsigned int tail;
+    void *item;
+    int spins = 0;
+
+    while ( !ring_pop( ring, &item ) ) {
+        if ( spins < RING_SPINS ) {
+            spins++;
+            sched_yield();
+            continue;
+        }
+
+        __atomic_store_n( &(ring->consumer_waiting), 1, __ATOMIC_SEQ_CST );
+        tail = __atomic_load_n( &(ring->tail), __ATOMIC_SEQ_CST );
+        if ( tail == ring->head ) {
+            futex_wait( &(ring->tail), tail );
+        }
+        __atomic_store_n( &(ring->consumer_waiting), 0, __ATOMIC_RELAXED );
+    }
+
+    return item;
+}
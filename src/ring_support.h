@@ -0,0 +1,57 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RING_SUPPORT_H__
+#define __RING_SUPPORT_H__
+
+/* A bounded, lock-free ring buffer of pointers, for passing work from
+   exactly one producer thread to exactly one consumer thread. Only
+   the producer changes "tail" and only the consumer changes "head",
+   and they are kept on separate cache lines so that the two threads
+   don't fight over them. A thread which has to wait sets its flag and
+   sleeps on the other thread's index, and the other thread wakes it
+   when it sees the flag. */
+
+#define RING_CACHE_LINE 64
+
+typedef struct ring {
+    void **slots;
+    unsigned int mask;
+    char pad0[RING_CACHE_LINE];
+    unsigned int head;
+    unsigned int consumer_waiting;
+    char pad1[RING_CACHE_LINE];
+    unsigned int tail;
+    unsigned int producer_waiting;
+    char pad2[RING_CACHE_LINE];
+} Ring;
+
+Ring *new_ring( unsigned int size );
+
+void free_ring( Ring *ring );
+
+int ring_push( Ring *ring, void *item );
+
+int ring_pop( Ring *ring, void **item );
+
+void ring_put( Ring *ring, void *item );
+
+void *ring_get( Ring *ring );
+
+
+#endif /* __RING_SUPPORT_H__ */
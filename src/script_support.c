@@ -0,0 +1,437 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alias_support.h"
+#include "dealias_support.h"
+#include "script_support.h"
+#include "allocator_support.h"
+
+/* The output is collected into a buffer of this size, and written
+   out whenever it fills up. */
+
+#define OUTPUT_SIZE 65536
+
+/* Once this much more of the script has been read, the pages which
+   have been read are given back. */
+
+#define RELEASE_SIZE (1024 * 1024)
+
+/* The longest logical line we will expand. A back-tick or quote which
+   is never closed would otherwise make the rest of the script one
+   line, to be copied and expanded all at once. */
+
+#define MAX_LINE_LENGTH (1024 * 1024)
+
+typedef struct script_output {
+    int fd;
+    int failed;
+    unsigned long unexpanded;
+    size_t used;
+    char buffer[OUTPUT_SIZE];
+} ScriptOutput;
+
+/* Lines starting with these words are copied as they are, as the
+   words which follow them aren't commands. */
+
+static const char *keywords[] = {
+    "foreach", "while", "switch", "case", "breaksw", "end", "endif",
+    "endsw", "else", "alias", "unalias", "set", "setenv", "@", NULL
+};
+
+static void flush_output( ScriptOutput *output )
+{
+    size_t written = 0;
+    ssize_t n;
+
+    while ( !output->failed && (written < output->used) ) {
+        n = write( output->fd, &(output->buffer[written]), output->used - written );
+        if ( n > 0 ) {
+            written += n;
+        } else if ( (n < 0) && (errno != EINTR) ) {
+            warn( "Unable to write the expanded script" );
+            output->failed = 1;
+        }
+    }
+
+    output->used = 0;
+}
+
+static void put_output( ScriptOutput *output, const char *text, size_t length )
+{
+    size_t n;
+
+    while ( length > 0 ) {
+        if ( output->used == OUTPUT_SIZE ) {
+            flush_output( output );
+        }
+
+        n = OUTPUT_SIZE - output->used;
+        if ( n > length ) {
+            n = length;
+        }
+        memcpy( &(output->buffer[output->used]), text, n );
+        output->used += n;
+        text += n;
+        length -= n;
+    }
+}
+
+/* Find the end of the logical line which starts at "start": the
+   first newline which isn't escaped or within back-ticks, or the end
+   of the script. Sets *comment to the start of any comment in the
+   line, or to the end of the line if there is none. Returns NULL if
+   the line, before any comment, is longer than MAX_LINE_LENGTH. */
+
+static const char *find_end_of_line( const char *start, const char *end,
+                                     const char **comment )
+{
+    const char *limit = end;
+    const char *p;
+    int escaped = 0;
+    int in_single_quote = 0;
+    int in_double_quote = 0;
+    int in_back_ticks = 0;
+    int word_start = 1;
+    char c;
+
+    if ( (size_t) (end - start) > MAX_LINE_LENGTH ) {
+        limit = start + MAX_LINE_LENGTH;
+    }
+
+    for ( p = start; p < limit; p++ ) {
+        c = *p;
+
+        if ( escaped ) {
+            escaped = 0;
+            word_start = 0;
+            continue;
+        }
+
+        switch ( c ) {
+        case '\\':
+            escaped = 1;
+            break;
+
+        case '\'':
+            in_single_quote ^= !in_double_quote;
+            break;
+
+        case '"':
+            in_double_quote ^= !in_single_quote;
+            break;
+
+        case '`':
+            in_back_ticks ^= !in_single_quote;
+            break;
+
+        case '#':
+            if ( word_start && !in_single_quote && !in_double_quote && !in_back_ticks ) {
+                *comment = p;
+                p = memchr( p, '\n', end - p );
+                return (p == NULL) ? end : p;
+            }
+            break;
+
+        case '\n':
+            if ( !in_back_ticks ) {
+                *comment = p;
+                return p;
+            }
+            break;
+        }
+
+        word_start = (strchr( " \t\n;&|()", c ) != NULL);
+    }
+
+    if ( limit < end ) {
+        return NULL;
+    }
+
+    *comment = end;
+    return end;
+}
+
+/* Copy a line which is too long to expand as it is, as far as the
+   end of its first physical line, and report it. Reading carries on
+   from the next line. Returns the end of what was copied. */
+
+static const char *copy_long_line( ScriptOutput *output, const char *line, const char *end )
+{
+    const char *newline = memchr( line, '\n', end - line );
+    size_t length = ((newline != NULL) ? newline : end) - line;
+
+    warnx( "Unable to expand \"%.*s%s\": the line is longer than %dM",
+           (int) ((length > 40) ? 40 : length), line, (length > 40) ? "..." : "",
+           MAX_LINE_LENGTH / (1024 * 1024) );
+    output->unexpanded++;
+
+    put_output( output, line, length );
+    if ( newline == NULL ) {
+        return end;
+    }
+
+    put_output( output, "\n", 1 );
+    return newline + 1;
+}
+
+/* Does the first word of the line tell us to leave it alone? */
+
+static int starts_with_keyword( const char *line, size_t length )
+{
+    size_t n = 0;
+    int i;
+
+    while ( (n < length) && !isspace( line[n] ) ) {
+        n++;
+    }
+
+    /* A label for goto, or "default:". */
+
+    if ( (n > 1) && (line[n-1] == ':') ) {
+        return 1;
+    }
+
+    for ( i = 0; keywords[i] != NULL; i++ ) {
+        if ( (strlen( keywords[i] ) == n) && (memcmp( keywords[i], line, n ) == 0) ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Might expanding this command change it? That is, does it have any
+   back-ticks, or does any of its simple commands start with an
+   alias? */
+
+static int might_expand( char *command, AliasTable *aliases )
+{
+    CommandList *commands;
+    Span *span;
+    char *text;
+    size_t n;
+    int found = 0;
+
+    if ( strchr( command, '`' ) != NULL ) {
+        return 1;
+    }
+
+    commands = split_into_simple_commands( copy_string( command ) );
+
+    for ( span = commands->spans; !found && (span < commands->spans + commands->n_spans); span++ ) {
+        if ( !span->is_separator ) {
+            text = &(commands->text[span->start]);
+            n = 0;
+            while ( (n < span->length) && !isspace( text[n] ) ) {
+                n++;
+            }
+            found = might_be_alias( aliases, text, n ) &&
+                    (find_alias( aliases, text, n ) != NO_ALIAS);
+        }
+    }
+
+    free_command_list( commands );
+
+    return found;
+}
+
+/* Does a newline between these two characters separate two commands,
+   or is there a command missing on one side of it? */
+
+static int separates_commands( char before, char after )
+{
+    return (strchr( "`;&|(", before ) == NULL) && (after != '`');
+}
+
+/* Make a copy of a command which may run over several lines, joining
+   up any continued lines, and separating any commands on separate
+   lines within back-ticks. */
+
+static char *join_lines( const char *line, size_t length )
+{
+    char *command = allocate( length + 1 );
+    size_t i;
+    size_t j = 0;
+    size_t k;
+    int escaped = 0;
+
+    for ( i = 0; i < length; i++ ) {
+        if ( escaped ) {
+            escaped = 0;
+            if ( line[i] == '\n' ) {
+                command[j-1] = ' ';
+                continue;
+            }
+        } else if ( line[i] == '\\' ) {
+            escaped = 1;
+        } else if ( line[i] == '\n' ) {
+            for ( k = j; (k > 0) && isspace( command[k-1] ); k-- ) {
+            }
+            while ( (i + 1 < length) && isspace( line[i+1] ) ) {
+                i++;
+            }
+            j = k;
+            if ( (k > 0) && (i + 1 < length) &&
+                 separates_commands( command[k-1], line[i+1] ) ) {
+                command[j++] = ';';
+            }
+            command[j++] = ' ';
+            continue;
+        }
+        command[j++] = line[i];
+    }
+    command[j] = '\0';
+
+    return command;
+}
+
+/* Write out a logical line, with its aliases expanded if it has any.
+   Only the command itself is expanded: any white space before and
+   after it, and any comment, are copied as they are. A line which
+   can't be expanded within the limits (see set_expansion_limits()) is
+   reported, and copied as it is. */
+
+static void expand_line( ScriptOutput *output, const char *line, const char *comment,
+                         const char *end, AliasTable *aliases )
+{
+    const char *start = line;
+    const char *stop = comment;
+    char *command = NULL;
+    char *result;
+
+    while ( (start < stop) && isspace( *start ) ) {
+        start++;
+    }
+    while ( (stop > start) && isspace( stop[-1] ) ) {
+        stop--;
+    }
+
+    if ( (start < stop) && !starts_with_keyword( start, stop - start ) ) {
+        command = join_lines( start, stop - start );
+    }
+
+    if ( (command == NULL) || !might_expand( command, aliases ) ) {
+        put_output( output, line, end - line );
+    } else if ( (result = dealias_command_line( command, aliases )) == NULL ) {
+        warnx( "Unable to expand \"%.40s%s\": %s", command,
+               (strlen( command ) > 40) ? "..." : "", expansion_error_message( errno ) );
+        output->unexpanded++;
+        put_output( output, line, end - line );
+    } else {
+        put_output( output, line, start - line );
+        put_output( output, result, strlen( result ) );
+        put_output( output, stop, end - stop );
+        deallocate( result );
+    }
+
+    deallocate( command );
+}
+
+/* Expand the aliases in the script in script_file, writing the
+   result to out_fd. Returns non-zero on an error. */
+
+int run_script( char *script_file, int out_fd, AliasTable *aliases )
+{
+    ScriptOutput *output;
+    struct stat st;
+    const char *script;
+    const char *line;
+    const char *end;
+    const char *eol;
+    const char *comment;
+    const char *released;
+    size_t page_size = sysconf( _SC_PAGESIZE );
+    size_t n;
+    int fd;
+    int status;
+
+    fd = open( script_file, O_RDONLY );
+    if ( fd < 0 ) {
+        warn( "Unable to open file %s", script_file );
+        return 1;
+    }
+
+    if ( fstat( fd, &st ) != 0 ) {
+        warn( "Unable to read file %s", script_file );
+        close( fd );
+        return 1;
+    }
+
+    if ( st.st_size == 0 ) {
+        close( fd );
+        return 0;
+    }
+
+    script = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( script == MAP_FAILED ) {
+        warn( "Unable to read file %s", script_file );
+        return 1;
+    }
+    madvise( (void *) script, st.st_size, MADV_SEQUENTIAL );
+
+    output = allocate( sizeof(ScriptOutput) );
+    output->fd = out_fd;
+    output->failed = 0;
+    output->unexpanded = 0;
+    output->used = 0;
+
+    end = script + st.st_size;
+    released = script;
+
+    for ( line = script; (line < end) && !output->failed; line = eol ) {
+        eol = find_end_of_line( line, end, &comment );
+        if ( eol == NULL ) {
+            eol = copy_long_line( output, line, end );
+        } else {
+            if ( eol < end ) {
+                eol++;
+            }
+
+            expand_line( output, line, comment, eol, aliases );
+        }
+
+        /* Give back the pages we've finished with. */
+
+        if ( (size_t) (line - released) >= RELEASE_SIZE ) {
+            n = (line - released) & ~(page_size - 1);
+            madvise( (void *) released, n, MADV_DONTNEED );
+            released += n;
+        }
+    }
+
+    flush_output( output );
+    status = output->failed || (output->unexpanded > 0);
+
+    deallocate( output );
+    munmap( (void *) script, st.st_size );
+
+    return status;
+}
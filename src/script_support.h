@@ -0,0 +1,43 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SCRIPT_SUPPORT_H__
+#define __SCRIPT_SUPPORT_H__
+
+#include "alias_support.h"
+
+/* Script mode expands the aliases in a whole tcsh script, and writes
+   out the script with every other line left exactly as it was.
+
+   The script is mapped into memory and read through once, a logical
+   line at a time: a line ends at a newline, unless the newline follows
+   a backslash or is within back-ticks. A comment, which starts with a
+   '#' at the start of a word outside any quotes, runs to the end of
+   the line and is copied as it is. Otherwise, if any simple command
+   in the line, or anything within back-ticks, might have an alias,
+   the line is expanded as a single command would be, with any
+   continued lines joined up first. The output is written as it is
+   made, and the parts of the script which have been read are given
+   back, so that the memory used doesn't grow with the script. A
+   logical line of more than 1M, as when a back-tick is never closed,
+   is reported, and its first line copied as it is. */
+
+int run_script( char *script_file, int out_fd, AliasTable *aliases );
+
+
+#endif /* __SCRIPT_SUPPORT_H__ */
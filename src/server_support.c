@@ -0,0 +1,976 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/fsuid.h>
+#include <sys/syscall.h>
+
+#include "alias_support.h"
+#include "dealias_support.h"
+#include "cache_support.h"
+#include "server_support.h"
+#include "allocator_support.h"
+#include "stats_support.h"
+
+#define BACKLOG 1024
+
+#define MAX_EVENTS 256
+
+#define READ_SIZE 65536
+
+/* We stop reading requests from a client which has this much output
+   waiting for it, until it has caught up. */
+
+#define HIGH_WATER (256 * 1024)
+
+/* The longest request that we will accept. */
+
+#define MAX_REQUEST (1024 * 1024)
+
+/* We stop reading from a client which has this much input waiting,
+   which is room for the longest request, until it has been dealt
+   with. */
+
+#define MAX_INPUT (MAX_REQUEST + FRAME_HEADER_SIZE)
+
+/* The most supplementary groups of a client that we take into
+   account. */
+
+#define MAX_PEER_GROUPS 64
+
+/* A TCP client could be anyone on the machine, so it gets the
+   identity of the user "nobody". */
+
+#define ANONYMOUS_ID 65534
+
+/* Until a client has sent enough to tell, we don't know which
+   protocol it is using. */
+
+#define PROTOCOL_UNKNOWN 0
+#define PROTOCOL_LINE 1
+#define PROTOCOL_BINARY 2
+
+/* Counters for the statistics, which any thread may update. */
+
+typedef struct server_counters {
+    unsigned long connections;
+    unsigned long line_requests;
+    unsigned long binary_requests;
+    unsigned long stats_requests;
+    unsigned long errors;
+} ServerCounters;
+
+static ServerCounters counters;
+
+/* Set by SIGUSR1, to ask for the statistics to be printed. */
+
+static volatile sig_atomic_t stats_wanted = 0;
+
+/* Who a client is, as far as reading its alias files goes. */
+
+typedef struct peer {
+    uid_t uid;
+    gid_t gid;
+    int n_groups;
+    gid_t groups[MAX_PEER_GROUPS];
+} Peer;
+
+/* Everything we know about one client connection. Input is read into
+   "in" until we have complete requests to process, and the responses
+   are queued in "out" until the client is ready to read them. */
+
+typedef struct connection {
+    int fd;
+    Peer peer;
+    int protocol;
+    char *in;
+    size_t in_used;
+    size_t in_size;
+    char *out;
+    size_t out_start;
+    size_t out_used;
+    size_t out_size;
+    unsigned int events;
+    int closing;
+} Connection;
+
+/* The server's own identity, which each thread goes back to once it
+   has opened a client's alias file. */
+
+static Peer server_identity;
+
+/* Each thread runs its own event loop. */
+
+typedef struct worker {
+    pthread_t thread;
+    int listener;
+    int shared_listener;
+    TableCache *cache;
+} Worker;
+
+/* An address of the form "host:port" is a TCP port, and anything else
+   is the path of a Unix domain socket. */
+
+static int is_tcp_address( char *address )
+{
+    return (strchr( address, ':' ) != NULL) && (strchr( address, '/' ) == NULL);
+}
+
+/* Look up a TCP address. With no host, it is the loopback address,
+   both to listen on and to connect to. */
+
+static struct addrinfo *resolve_tcp_address( char *address )
+{
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    char *host = strdup( address );
+    char *port = strrchr( host, ':' );
+    int status;
+
+    *port++ = '\0';
+
+    memset( &hints, 0, sizeof(hints) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    status = getaddrinfo( (*host != '\0') ? host : NULL, port, &hints, &result );
+    if ( status != 0 ) {
+        warnx( "Unable to resolve %s: %s", address, gai_strerror( status ) );
+        result = NULL;
+    }
+
+    free( host );
+    return result;
+}
+
+/* Fill in the address of a Unix domain socket. Returns zero if the
+   path is too long. */
+
+static int unix_address( struct sockaddr_un *address, char *socket_path )
+{
+    memset( address, 0, sizeof(*address) );
+    address->sun_family = AF_UNIX;
+
+    if ( strlen( socket_path ) >= sizeof(address->sun_path) ) {
+        warnx( "Socket path too long: %s", socket_path );
+        return 0;
+    }
+
+    strcpy( address->sun_path, socket_path );
+    return 1;
+}
+
+/* Create a non-blocking socket listening on an address, with a Unix
+   domain socket given the permissions in mode. Returns -1 if that
+   isn't possible. */
+
+static int open_listener( char *address, int reuse_port, mode_t mode )
+{
+    struct sockaddr_un unix_socket;
+    struct addrinfo *info;
+    mode_t old_mask;
+    int fd = -1;
+    int on = 1;
+
+    if ( is_tcp_address( address ) ) {
+        info = resolve_tcp_address( address );
+        if ( info == NULL ) {
+            return -1;
+        }
+
+        fd = socket( info->ai_family, info->ai_socktype | SOCK_NONBLOCK, info->ai_protocol );
+        if ( fd >= 0 ) {
+            setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+            if ( reuse_port ) {
+                setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on) );
+            }
+
+            if ( bind( fd, info->ai_addr, info->ai_addrlen ) != 0 ) {
+                close( fd );
+                fd = -1;
+            }
+        }
+
+        freeaddrinfo( info );
+    } else if ( unix_address( &unix_socket, address ) ) {
+        fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0 );
+        unlink( address );
+
+        /* Nobody else may connect until the socket has its permissions.
+           This is done before there are any other threads. */
+
+        old_mask = umask( 0177 );
+        if ( (fd >= 0) &&
+             ((bind( fd, (struct sockaddr *) &unix_socket, sizeof(unix_socket) ) != 0) ||
+              (chmod( address, mode ) != 0)) ) {
+            close( fd );
+            fd = -1;
+        }
+        umask( old_mask );
+    }
+
+    if ( (fd >= 0) && (listen( fd, BACKLOG ) != 0) ) {
+        close( fd );
+        fd = -1;
+    }
+
+    if ( fd < 0 ) {
+        warn( "Unable to listen on %s", address );
+    }
+
+    return fd;
+}
+
+/* Connect to a server. Returns a (blocking) socket, or -1. */
+
+int connect_to_server( char *address )
+{
+    struct sockaddr_un unix_socket;
+    struct addrinfo *info;
+    int fd = -1;
+
+    if ( is_tcp_address( address ) ) {
+        info = resolve_tcp_address( address );
+        if ( info == NULL ) {
+            return -1;
+        }
+
+        fd = socket( info->ai_family, info->ai_socktype, info->ai_protocol );
+        if ( (fd >= 0) && (connect( fd, info->ai_addr, info->ai_addrlen ) != 0) ) {
+            close( fd );
+            fd = -1;
+        }
+
+        freeaddrinfo( info );
+    } else if ( unix_address( &unix_socket, address ) ) {
+        fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+        if ( (fd >= 0) &&
+             (connect( fd, (struct sockaddr *) &unix_socket, sizeof(unix_socket) ) != 0) ) {
+            close( fd );
+            fd = -1;
+        }
+    }
+
+    if ( fd < 0 ) {
+        warn( "Unable to connect to %s", address );
+    }
+
+    return fd;
+}
+
+/* Find out who is at the other end of a new connection: the user of
+   a Unix domain socket client, or "nobody" for a TCP client. */
+
+static void identify_peer( int fd, Peer *peer )
+{
+    struct sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    struct ucred credentials;
+
+    peer->uid = ANONYMOUS_ID;
+    peer->gid = ANONYMOUS_ID;
+    peer->n_groups = 0;
+
+    if ( (getsockname( fd, (struct sockaddr *) &address, &length ) != 0) ||
+         (address.ss_family != AF_UNIX) ) {
+        return;
+    }
+
+    length = sizeof(credentials);
+    if ( getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length ) != 0 ) {
+        return;
+    }
+    peer->uid = credentials.uid;
+    peer->gid = credentials.gid;
+
+    /* Without its supplementary groups, a client can still use any
+       file it could read through its own user or group. */
+
+    length = sizeof(peer->groups);
+    if ( getsockopt( fd, SOL_SOCKET, SO_PEERGROUPS, peer->groups, &length ) == 0 ) {
+        peer->n_groups = length / sizeof(gid_t);
+    }
+}
+
+/* Have the calling thread open files as a given user and groups, so
+   that the kernel checks a client's permissions for us. Calling the
+   setgroups system call directly only changes the calling thread,
+   where the C library's setgroups() changes every thread. Returns
+   zero if the thread couldn't take on the identity, as when a server
+   not run by root has a client who is someone else. */
+
+static int set_file_identity( Peer *peer )
+{
+    if ( (peer->uid == server_identity.uid) && (server_identity.uid != 0) ) {
+        return 1;
+    }
+
+    if ( syscall( SYS_setgroups, peer->n_groups, peer->groups ) != 0 ) {
+        return 0;
+    }
+
+    setfsgid( peer->gid );
+    setfsuid( peer->uid );
+
+    /* Neither of these reports failure, but asking for an invalid id
+       gives the current one. */
+
+    return ((gid_t) setfsgid( -1 ) == peer->gid) && ((uid_t) setfsuid( -1 ) == peer->uid);
+}
+
+/* Look up the alias table for a client, opening the file as the
+   client. Returns NULL if the client couldn't read the file itself. */
+
+static AliasTable *get_peer_alias_table( TableCache *cache, Peer *peer, char *alias_file )
+{
+    AliasTable *aliases = NULL;
+
+    if ( set_file_identity( peer ) ) {
+        aliases = get_alias_table( cache, alias_file );
+    }
+
+    set_file_identity( &server_identity );
+
+    return aliases;
+}
+
+/* Expand a command for a client using an alias file, or no aliases
+   at all if alias_file is NULL, with the given EXPAND_ flags. Returns
+   the expanded command, with its length in *length, or an error
+   message with *is_error set. */
+
+static char *expand_request( TableCache *cache, Peer *peer, char *alias_file, char *command,
+                             size_t command_length, int flags, size_t *length,
+                             int *is_error )
+{
+    AliasTable *aliases = NULL;
+    char *result;
+    const char *message;
+    unsigned long long request_start;
+    unsigned long long start;
+
+    *is_error = 0;
+
+    start_request_timing();
+    request_start = start_phase();
+
+    if ( alias_file != NULL ) {
+        start = start_phase();
+        aliases = get_peer_alias_table( cache, peer, alias_file );
+        end_phase( PHASE_TABLE, start );
+
+        if ( aliases == NULL ) {
+            __atomic_add_fetch( &(counters.errors), 1, __ATOMIC_RELAXED );
+            *is_error = 1;
+            *length = strlen( "Unable to read alias file " ) + strlen( alias_file );
+            result = allocate( *length + 1 );
+            snprintf( result, *length + 1, "Unable to read alias file %s", alias_file );
+            return result;
+        }
+    }
+
+    /* A command which can't be expanded within the limits only costs
+       its own request an error, and the thread then goes on to the
+       next request. */
+
+    result = expand_command_line( command, command_length, flags, aliases, length );
+    release_alias_table( cache, aliases );
+
+    if ( result == NULL ) {
+        __atomic_add_fetch( &(counters.errors), 1, __ATOMIC_RELAXED );
+        *is_error = 1;
+        message = expansion_error_message( errno );
+        *length = strlen( "Unable to expand the command: " ) + strlen( message );
+        result = allocate( *length + 1 );
+        snprintf( result, *length + 1, "Unable to expand the command: %s", message );
+    }
+
+    end_phase( PHASE_REQUEST, request_start );
+    end_request_timing();
+
+    return result;
+}
+
+/* Print the server's statistics. */
+
+static void print_server_stats( TableCache *cache, FILE *f )
+{
+    fprintf( f, "Connections: %lu\n", counters.connections );
+    fprintf( f, "Line requests: %lu\n", counters.line_requests );
+    fprintf( f, "Binary requests: %lu\n", counters.binary_requests );
+    fprintf( f, "Stats requests: %lu\n", counters.stats_requests );
+    fprintf( f, "Errors: %lu\n", counters.errors );
+    print_cache_stats( cache, f );
+    print_phase_stats( f );
+}
+
+/* Return the statistics as a string, which the caller should free(),
+   setting its length. */
+
+static char *format_server_stats( TableCache *cache, size_t *length )
+{
+    char *text = NULL;
+    FILE *f;
+
+    __atomic_add_fetch( &(counters.stats_requests), 1, __ATOMIC_RELAXED );
+
+    f = open_memstream( &text, length );
+    print_server_stats( cache, f );
+    fclose( f );
+
+    return text;
+}
+
+static void request_stats( int signal_number )
+{
+    stats_wanted = 1;
+}
+
+static size_t pending_output( Connection *conn )
+{
+    return conn->out_used - conn->out_start;
+}
+
+static void queue_output( Connection *conn, const void *data, size_t length )
+{
+    if ( conn->out_used + length > conn->out_size ) {
+        conn->out_size = 2 * conn->out_size + length;
+        conn->out = realloc( conn->out, conn->out_size );
+    }
+
+    memcpy( &(conn->out[conn->out_used]), data, length );
+    conn->out_used += length;
+}
+
+/* Handle a single line protocol request, which has had its '\n'
+   removed, and queue the response. */
+
+static void handle_line_request( Connection *conn, TableCache *cache, char *request )
+{
+    char *tab;
+    char *alias_file;
+    char *result;
+    size_t length;
+    int is_error;
+
+    if ( strcmp( request, "STATS" ) == 0 ) {
+        result = format_server_stats( cache, &length );
+        queue_output( conn, result, length );
+        queue_output( conn, "END\n", 4 );
+        free( result );
+        return;
+    }
+
+    __atomic_add_fetch( &(counters.line_requests), 1, __ATOMIC_RELAXED );
+
+    tab = strchr( request, '\t' );
+    if ( tab == NULL ) {
+        __atomic_add_fetch( &(counters.errors), 1, __ATOMIC_RELAXED );
+        queue_output( conn, "ERR Malformed request\n", 22 );
+        return;
+    }
+
+    *tab = '\0';
+    alias_file = (strcmp( request, "-noalias" ) == 0) ? NULL : request;
+
+    result = expand_request( cache, &(conn->peer), alias_file, tab + 1, strlen( tab + 1 ),
+                             0, &length, &is_error );
+
+    queue_output( conn, is_error ? "ERR " : "OK ", is_error ? 4 : 3 );
+    queue_output( conn, result, length );
+    queue_output( conn, "\n", 1 );
+
+    deallocate( result );
+}
+
+/* Handle every complete line in the input buffer, unless the client
+   has fallen too far behind in reading the responses. Once the client
+   has closed its end, any final request without a '\n' also counts as
+   complete. Returns the number of bytes used, or -1 if a line is
+   longer than we will accept. */
+
+static ssize_t process_lines( Connection *conn, TableCache *cache )
+{
+    size_t start = 0;
+    char *newline;
+
+    while ( (start < conn->in_used) && (pending_output( conn ) < HIGH_WATER) ) {
+        newline = memchr( &(conn->in[start]), '\n', conn->in_used - start );
+        if ( newline == NULL ) {
+            if ( conn->in_used - start >= MAX_REQUEST ) {
+                queue_output( conn, "ERR Request too long\n", 21 );
+                return -1;
+            }
+            if ( !conn->closing ) {
+                break;
+            }
+            newline = &(conn->in[conn->in_used]);
+        }
+
+        *newline = '\0';
+        handle_line_request( conn, cache, &(conn->in[start]) );
+
+        start = (newline - conn->in) + 1;
+        if ( start > conn->in_used ) {
+            start = conn->in_used;
+        }
+    }
+
+    return start;
+}
+
+/* Queue a binary protocol response of length bytes. */
+
+static void queue_frame( Connection *conn, unsigned int id, int flags,
+                         char *data, size_t length )
+{
+    unsigned char header[FRAME_HEADER_SIZE];
+    FrameHeader frame;
+
+    frame.id = id;
+    frame.flags = flags;
+    frame.path_length = 0;
+    frame.length = length;
+
+    encode_frame_header( header, &frame );
+    queue_output( conn, header, FRAME_HEADER_SIZE );
+    queue_output( conn, data, frame.length );
+}
+
+/* Handle every complete frame in the input buffer, as for
+   process_lines(). Returns the number of bytes used, or -1 if the
+   client has sent something we can't make sense of. */
+
+static ssize_t process_frames( Connection *conn, TableCache *cache )
+{
+    size_t start = 0;
+    FrameHeader frame;
+    char *alias_file;
+    char *command;
+    char *result;
+    size_t length;
+    size_t frame_size;
+    int flags;
+    int is_error;
+
+    while ( (conn->in_used - start >= FRAME_HEADER_SIZE) &&
+            (pending_output( conn ) < HIGH_WATER) ) {
+        decode_frame_header( (unsigned char *) &(conn->in[start]), &frame );
+
+        /* The lengths come from the client, so check each of them
+           before adding them up. */
+
+        if ( (frame.path_length > MAX_REQUEST) || (frame.length > MAX_REQUEST) ||
+             ((size_t) frame.path_length + frame.length > MAX_REQUEST) ) {
+            queue_frame( conn, frame.id, RESPONSE_ERROR, "Request too long", 16 );
+            return -1;
+        }
+
+        frame_size = FRAME_HEADER_SIZE + (size_t) frame.path_length + frame.length;
+        if ( conn->in_used - start < frame_size ) {
+            break;
+        }
+
+        start += FRAME_HEADER_SIZE;
+
+        if ( frame.flags & REQUEST_STATS ) {
+            start += frame_size - FRAME_HEADER_SIZE;
+            result = format_server_stats( cache, &length );
+            queue_frame( conn, frame.id, 0, result, length );
+            free( result );
+            continue;
+        }
+
+        __atomic_add_fetch( &(counters.binary_requests), 1, __ATOMIC_RELAXED );
+
+        if ( frame.flags & REQUEST_NOALIAS ) {
+            alias_file = NULL;
+        } else {
+            alias_file = strndup( &(conn->in[start]), frame.path_length );
+        }
+        start += frame.path_length;
+
+        /* The command may hold '\0's, so keep its length rather than
+           relying on strndup() to copy it. */
+
+        command = malloc( (size_t) frame.length + 1 );
+        memcpy( command, &(conn->in[start]), frame.length );
+        command[frame.length] = '\0';
+        start += frame.length;
+
+        flags = 0;
+        if ( frame.flags & REQUEST_ARGV ) {
+            flags |= EXPAND_ARGV;
+        }
+        if ( frame.flags & REQUEST_NUL_WORDS ) {
+            flags |= EXPAND_NUL_WORDS;
+        }
+
+        result = expand_request( cache, &(conn->peer), alias_file, command, frame.length,
+                                 flags, &length, &is_error );
+        queue_frame( conn, frame.id, is_error ? RESPONSE_ERROR : 0, result, length );
+
+        deallocate( result );
+        free( command );
+        free( alias_file );
+    }
+
+    return start;
+}
+
+/* Handle the complete requests in the input buffer, in whichever
+   protocol the client is using, and drop them from the buffer.
+   Returns -1 if the connection should be dropped once the output has
+   been sent. */
+
+static int process_input( Connection *conn, TableCache *cache )
+{
+    ssize_t used;
+
+    if ( conn->protocol == PROTOCOL_UNKNOWN ) {
+        if ( conn->in_used == 0 ) {
+            return 0;
+        }
+
+        if ( (conn->in_used >= BINARY_MAGIC_LENGTH) &&
+             (memcmp( conn->in, BINARY_MAGIC, BINARY_MAGIC_LENGTH ) == 0) ) {
+            conn->protocol = PROTOCOL_BINARY;
+            conn->in_used -= BINARY_MAGIC_LENGTH;
+            memmove( conn->in, &(conn->in[BINARY_MAGIC_LENGTH]), conn->in_used );
+        } else if ( (conn->in_used >= BINARY_MAGIC_LENGTH) ||
+                    (conn->in[0] != BINARY_MAGIC[0]) || conn->closing ) {
+            conn->protocol = PROTOCOL_LINE;
+        } else {
+            return 0;
+        }
+    }
+
+    if ( conn->protocol == PROTOCOL_BINARY ) {
+        used = process_frames( conn, cache );
+    } else {
+        used = process_lines( conn, cache );
+    }
+
+    if ( used < 0 ) {
+        conn->in_used = 0;
+        return -1;
+    }
+
+    memmove( conn->in, &(conn->in[used]), conn->in_used - used );
+    conn->in_used -= used;
+
+    return 0;
+}
+
+/* Read whatever the client has sent, up to MAX_INPUT bytes. Returns
+   -1 if the connection should be dropped. */
+
+static int read_input( Connection *conn )
+{
+    ssize_t n;
+
+    while ( !conn->closing && (conn->in_used < MAX_INPUT) ) {
+        if ( conn->in_used + READ_SIZE + 1 > conn->in_size ) {
+            conn->in_size = conn->in_used + READ_SIZE + 1;
+            conn->in = realloc( conn->in, conn->in_size );
+        }
+
+        n = read( conn->fd, &(conn->in[conn->in_used]), READ_SIZE );
+        if ( n > 0 ) {
+            conn->in_used += n;
+        } else if ( n == 0 ) {
+            conn->closing = 1;
+        } else if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+            break;
+        } else if ( errno != EINTR ) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Send as much of the queued output as the client will take. Returns
+   -1 if the connection should be dropped. */
+
+static int write_output( Connection *conn )
+{
+    ssize_t n;
+
+    while ( pending_output( conn ) > 0 ) {
+        n = write( conn->fd, &(conn->out[conn->out_start]), pending_output( conn ) );
+        if ( n > 0 ) {
+            conn->out_start += n;
+        } else if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+            break;
+        } else if ( errno != EINTR ) {
+            return -1;
+        }
+    }
+
+    if ( pending_output( conn ) == 0 ) {
+        conn->out_start = 0;
+        conn->out_used = 0;
+    }
+
+    return 0;
+}
+
+/* Only ask to hear about input when we have room for it, and about
+   output when we have something to write. A client which has sent a
+   burst of requests before reading any of the responses can carry on
+   sending while its responses back up, until the input buffer is
+   full. */
+
+static void update_events( int epoll_fd, Connection *conn )
+{
+    struct epoll_event event;
+    unsigned int wanted = 0;
+
+    if ( !conn->closing && (conn->in_used < MAX_INPUT) ) {
+        wanted |= EPOLLIN;
+    }
+
+    if ( pending_output( conn ) > 0 ) {
+        wanted |= EPOLLOUT;
+    }
+
+    if ( wanted != conn->events ) {
+        event.events = wanted;
+        event.data.ptr = conn;
+        epoll_ctl( epoll_fd, EPOLL_CTL_MOD, conn->fd, &event );
+        conn->events = wanted;
+    }
+}
+
+static void close_connection( int epoll_fd, Connection *conn )
+{
+    epoll_ctl( epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL );
+    close( conn->fd );
+    free( conn->in );
+    free( conn->out );
+    free( conn );
+}
+
+static void accept_connections( int epoll_fd, int listener )
+{
+    struct epoll_event event;
+    Connection *conn;
+    int fd;
+
+    while ( (fd = accept4( listener, NULL, NULL, SOCK_NONBLOCK )) >= 0 ) {
+        __atomic_add_fetch( &(counters.connections), 1, __ATOMIC_RELAXED );
+
+        conn = calloc( 1, sizeof(Connection) );
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        identify_peer( fd, &(conn->peer) );
+
+        event.events = conn->events;
+        event.data.ptr = conn;
+        epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &event );
+    }
+}
+
+/* Handle whatever has happened on a connection. A client may have
+   sent many requests at once, more than we will answer while it
+   isn't reading the responses, and it may send nothing more until it
+   has them all, so we carry on handling the requests we have for as
+   long as the client keeps taking the responses. Once the client has
+   closed its end, and has all its responses, any input left over is a
+   request which can never be completed. */
+
+static void service_connection( int epoll_fd, Connection *conn,
+                                unsigned int events, TableCache *cache )
+{
+    size_t in_used;
+
+    if ( (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (read_input( conn ) < 0) ) {
+        close_connection( epoll_fd, conn );
+        return;
+    }
+
+    do {
+        if ( write_output( conn ) < 0 ) {
+            close_connection( epoll_fd, conn );
+            return;
+        }
+
+        in_used = conn->in_used;
+        if ( (pending_output( conn ) < HIGH_WATER) && (process_input( conn, cache ) < 0) ) {
+            conn->closing = 1;
+        }
+    } while ( conn->in_used < in_used );
+
+    if ( conn->closing && (pending_output( conn ) == 0) ) {
+        close_connection( epoll_fd, conn );
+    } else {
+        update_events( epoll_fd, conn );
+    }
+}
+
+/* A thread's event loop. The listening socket is registered with a
+   NULL pointer, and every connection with a pointer to its state. */
+
+static void *serve( void *arg )
+{
+    Worker *worker = arg;
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event;
+    int epoll_fd;
+    int n;
+    int i;
+
+    epoll_fd = epoll_create1( 0 );
+
+    event.events = EPOLLIN | (worker->shared_listener ? EPOLLEXCLUSIVE : 0);
+    event.data.ptr = NULL;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, worker->listener, &event );
+
+    for ( ;; ) {
+        n = epoll_wait( epoll_fd, events, MAX_EVENTS, -1 );
+
+        /* SIGUSR1 interrupts whichever thread it is delivered to, and
+           only one thread should print the statistics. */
+
+        if ( stats_wanted && __atomic_exchange_n( &stats_wanted, 0, __ATOMIC_ACQ_REL ) ) {
+            print_server_stats( worker->cache, stderr );
+        }
+
+        for ( i = 0; i < n; i++ ) {
+            if ( events[i].data.ptr == NULL ) {
+                accept_connections( epoll_fd, worker->listener );
+            } else {
+                service_connection( epoll_fd, events[i].data.ptr, events[i].events,
+                                    worker->cache );
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Serve requests for ever, using n_threads threads, or one per
+   processor if n_threads is zero, on a Unix domain socket with the
+   permissions in socket_mode or a TCP port. Only returns if the
+   server can't be set up. */
+
+int run_server( char *address, TableCache *cache, int n_threads, mode_t socket_mode )
+{
+    Worker *workers;
+    struct sigaction action;
+    int tcp = is_tcp_address( address );
+    int i;
+
+    if ( n_threads <= 0 ) {
+        n_threads = sysconf( _SC_NPROCESSORS_ONLN );
+        if ( n_threads <= 0 ) {
+            n_threads = 1;
+        }
+    }
+
+    /* A client going away mid-response shouldn't kill the server. */
+    signal( SIGPIPE, SIG_IGN );
+
+    memset( &action, 0, sizeof(action) );
+    action.sa_handler = request_stats;
+    sigemptyset( &(action.sa_mask) );
+    sigaction( SIGUSR1, &action, NULL );
+
+    enable_phase_timing();
+
+    server_identity.uid = geteuid();
+    server_identity.gid = getegid();
+    server_identity.n_groups = getgroups( MAX_PEER_GROUPS, server_identity.groups );
+    if ( server_identity.n_groups < 0 ) {
+        server_identity.n_groups = 0;
+    }
+
+    workers = calloc( n_threads, sizeof(Worker) );
+
+    for ( i = 0; i < n_threads; i++ ) {
+        workers[i].cache = cache;
+
+        if ( tcp || (i == 0) ) {
+            workers[i].listener = open_listener( address, tcp && (n_threads > 1), socket_mode );
+            if ( workers[i].listener < 0 ) {
+                return 1;
+            }
+        } else {
+            workers[i].listener = workers[0].listener;
+        }
+
+        workers[i].shared_listener = !tcp && (n_threads > 1);
+    }
+
+    for ( i = 1; i < n_threads; i++ ) {
+        pthread_create( &(workers[i].thread), NULL, serve, &(workers[i]) );
+    }
+
+    serve( &(workers[0]) );
+
+    return 0;
+}
+
+/* Frame headers are sent in network byte order. */
+
+static void put_u32( unsigned char *p, unsigned int value )
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static unsigned int get_u32( unsigned char *p )
+{
+    return ((unsigned int) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void encode_frame_header( unsigned char *buffer, FrameHeader *frame )
+{
+    put_u32( buffer, frame->id );
+    buffer[4] = frame->flags >> 8;
+    buffer[5] = frame->flags;
+    buffer[6] = frame->path_length >> 8;
+    buffer[7] = frame->path_length;
+    put_u32( &(buffer[8]), frame->length );
+}
+
+void decode_frame_header( unsigned char *buffer, FrameHeader *frame )
+{
+    frame->id = get_u32( buffer );
+    frame->flags = (buffer[4] << 8) | buffer[5];
+    frame->path_length = (buffer[6] << 8) | buffer[7];
+    frame->length = get_u32( &(buffer[8]) );
+}
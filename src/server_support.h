@@ -0,0 +1,117 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SERVER_SUPPORT_H__
+#define __SERVER_SUPPORT_H__
+
+#include <sys/types.h>
+
+#include "cache_support.h"
+
+/* In server mode tcshParser stays resident and expands commands for
+   any number of users. The server listens either on a Unix domain
+   socket, given by its path, or on a TCP port, given as "host:port".
+   With no host, the port is on the loopback address.
+
+   A client names its alias file, and the server opens it as the
+   client: as the user at the other end of a Unix domain socket, found
+   with SO_PEERCRED, or as "nobody" for a TCP client, who could be
+   anyone. So a client can only use an alias file which it could read
+   itself. This needs a server run by root. Any other server only
+   opens alias files for its own user, over a Unix domain socket,
+   which is only open to that user unless given other permissions.
+
+   Clients can use either of two protocols. In the line protocol, each
+   request is a single line, holding the alias file to use (or
+   "-noalias") and the command, separated by a tab:
+
+       <alias-file> TAB <command> NEWLINE
+
+   and each response is a single line, either
+
+       OK <expanded command> NEWLINE
+       ERR <message> NEWLINE
+
+   The line protocol is easy to use from a script, but a command can't
+   contain a newline. In the binary protocol the client starts by
+   sending the four bytes of BINARY_MAGIC, and after that each request
+   is a frame header, followed by path_length bytes of alias file and
+   length bytes of command. Each response is a frame header, with the
+   id of the request and a path_length of zero, followed by length
+   bytes of expanded command or, if RESPONSE_ERROR is set, an error
+   message. The numbers in a header are sent in network byte order:
+
+       id            4 bytes   chosen by the client
+       flags         2 bytes   REQUEST_ flags or RESPONSE_ERROR
+       path_length   2 bytes
+       length        4 bytes
+
+   With REQUEST_ARGV the command is a sequence of words, each ended by
+   a '\0', as in argv. With REQUEST_NUL_WORDS the response is the words
+   of the expanded command, each ended by a '\0'.
+
+   A client can also ask for the server's statistics: the number of
+   requests, how the alias table cache is doing, and histograms of how
+   long requests spend in each phase of expanding a command (see
+   stats_support.h). In the line protocol the request is the line
+   "STATS", and the response is any number of lines, ended by the
+   line "END". In the binary protocol it is a request with
+   REQUEST_STATS set, and the response is the text of the statistics.
+   Sending the server SIGUSR1 prints them on its standard error.
+
+   In either protocol a client may send any number of requests without
+   waiting for the responses. Line protocol responses come back in
+   order. Binary protocol responses may come back in any order, and
+   clients must use the ids to match them up with the requests. The
+   server stops reading while a client isn't reading its responses. A
+   request may be up to 1M long: a longer one gets an error, and the
+   connection is closed.
+
+   All the connections are served by a non-blocking epoll loop. With
+   more than one thread, each thread runs its own loop: on a TCP port
+   each has its own listening socket, bound with SO_REUSEPORT, while
+   threads sharing a Unix domain socket take turns to accept. */
+
+#define BINARY_MAGIC "\0TPB"
+#define BINARY_MAGIC_LENGTH 4
+
+#define FRAME_HEADER_SIZE 12
+
+#define REQUEST_NOALIAS 1
+#define REQUEST_ARGV 2
+#define REQUEST_NUL_WORDS 4
+#define REQUEST_STATS 8
+#define RESPONSE_ERROR 1
+
+typedef struct frame_header {
+    unsigned int id;
+    unsigned int flags;
+    unsigned int path_length;
+    unsigned int length;
+} FrameHeader;
+
+int run_server( char *address, TableCache *cache, int n_threads, mode_t socket_mode );
+
+int connect_to_server( char *address );
+
+void encode_frame_header( unsigned char *buffer, FrameHeader *frame );
+
+void decode_frame_header( unsigned char *buffer, FrameHeader *frame );
+
+
+#endif /* __SERVER_SUPPORT_H__ */
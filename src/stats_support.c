@@ -0,0 +1,207 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats_support.h"
+
+static const char *phase_names[N_PHASES] = {
+    "request", "table", "split", "history", "back-ticks", "post"
+};
+
+static Histogram phase_histograms[N_PHASES];
+
+static int phase_timing = 0;
+
+/* Reading the clock costs tens of nanoseconds, and a request reads it
+   a dozen times, so only one request in TIMING_INTERVAL is timed. That
+   still gives a fair picture of the whole distribution. */
+
+#define TIMING_INTERVAL 16
+
+/* Whether this thread's current request is being timed, the time it
+   has spent so far in each phase, and which phases it has reached. */
+
+static __thread int timing_request;
+static __thread unsigned int requests_seen;
+static __thread unsigned long long phase_times[N_PHASES];
+static __thread unsigned int phases_reached;
+
+/* The bucket for a value is found from its highest set bit and the
+   HISTOGRAM_SUB_BITS bits below it. */
+
+static int bucket_index( unsigned long long value )
+{
+    int shift;
+
+    if ( value < 2 * HISTOGRAM_SUB_BUCKETS ) {
+        return (int) value;
+    }
+
+    shift = 63 - __builtin_clzll( value ) - HISTOGRAM_SUB_BITS;
+
+    return (shift * HISTOGRAM_SUB_BUCKETS) + (int) (value >> shift);
+}
+
+/* The highest value which is recorded in a bucket. */
+
+static unsigned long long bucket_value( int index )
+{
+    int shift;
+    unsigned long long sub_bucket;
+
+    if ( index < 2 * HISTOGRAM_SUB_BUCKETS ) {
+        return index;
+    }
+
+    shift = (index / HISTOGRAM_SUB_BUCKETS) - 1;
+    sub_bucket = (index % HISTOGRAM_SUB_BUCKETS) + HISTOGRAM_SUB_BUCKETS;
+
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void record_value( Histogram *histogram, unsigned long long value )
+{
+    unsigned long long max = __atomic_load_n( &(histogram->max), __ATOMIC_RELAXED );
+
+    __atomic_add_fetch( &(histogram->counts[bucket_index( value )]), 1, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &(histogram->count), 1, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &(histogram->total), value, __ATOMIC_RELAXED );
+
+    while ( (value > max) &&
+            !__atomic_compare_exchange_n( &(histogram->max), &max, value, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) {
+    }
+}
+
+/* The value which percentile percent of the recorded values are no
+   more than, to within the histogram's precision. */
+
+unsigned long long value_at_percentile( Histogram *histogram, double percentile )
+{
+    unsigned long count = __atomic_load_n( &(histogram->count), __ATOMIC_RELAXED );
+    unsigned long wanted;
+    unsigned long seen = 0;
+    unsigned long long max;
+    int i;
+
+    if ( count == 0 ) {
+        return 0;
+    }
+
+    wanted = (unsigned long) (count * percentile / 100.0 + 0.5);
+    if ( wanted < 1 ) {
+        wanted = 1;
+    }
+
+    max = __atomic_load_n( &(histogram->max), __ATOMIC_RELAXED );
+
+    for ( i = 0; i < HISTOGRAM_BUCKETS; i++ ) {
+        seen += __atomic_load_n( &(histogram->counts[i]), __ATOMIC_RELAXED );
+        if ( seen >= wanted ) {
+            return (bucket_value( i ) < max) ? bucket_value( i ) : max;
+        }
+    }
+
+    return max;
+}
+
+/* Timing is only done once a resident server has asked for it. */
+
+void enable_phase_timing( void )
+{
+    phase_timing = 1;
+}
+
+void start_request_timing( void )
+{
+    timing_request = phase_timing && ((requests_seen++ % TIMING_INTERVAL) == 0);
+    memset( phase_times, 0, sizeof(phase_times) );
+    phases_reached = 0;
+}
+
+/* Record the current request's time in each phase it reached. */
+
+void end_request_timing( void )
+{
+    int i;
+
+    for ( i = 0; i < N_PHASES; i++ ) {
+        if ( phases_reached & (1u << i) ) {
+            record_value( &(phase_histograms[i]), phase_times[i] );
+        }
+    }
+
+    phases_reached = 0;
+    timing_request = 0;
+}
+
+/* Returns the time at the start of a phase, to be passed to
+   end_phase(), or zero if the request isn't being timed. */
+
+unsigned long long start_phase( void )
+{
+    struct timespec now;
+
+    if ( !timing_request ) {
+        return 0;
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (unsigned long long) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void end_phase( Phase phase, unsigned long long start )
+{
+    if ( start != 0 ) {
+        phase_times[phase] += start_phase() - start;
+        phases_reached |= 1u << phase;
+    }
+}
+
+/* Print the count, mean and percentiles of each phase, in
+   microseconds. */
+
+void print_phase_stats( FILE *f )
+{
+    static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+    Histogram *histogram;
+    unsigned long count;
+    int i;
+    int j;
+
+    fprintf( f, "%-12s %10s %9s %9s %9s %9s %9s %9s\n", "Phase (us)", "count", "mean",
+             "p50", "p90", "p99", "p99.9", "max" );
+
+    for ( i = 0; i < N_PHASES; i++ ) {
+        histogram = &(phase_histograms[i]);
+        count = __atomic_load_n( &(histogram->count), __ATOMIC_RELAXED );
+
+        fprintf( f, "%-12s %10lu %9.2f", phase_names[i], count,
+                 (count > 0) ? (histogram->total / 1000.0 / count) : 0.0 );
+        for ( j = 0; j < (int) (sizeof(percentiles) / sizeof(percentiles[0])); j++ ) {
+            fprintf( f, " %9.2f", value_at_percentile( histogram, percentiles[j] ) / 1000.0 );
+        }
+        fprintf( f, " %9.2f\n", __atomic_load_n( &(histogram->max), __ATOMIC_RELAXED ) / 1000.0 );
+    }
+}
@@ -0,0 +1,79 @@
+/*  This file is part of tcshParser.
+
+    Copyright (C) 2013 Ellexus (www.ellexus.com)
+
+    tcshParser is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STATS_SUPPORT_H__
+#define __STATS_SUPPORT_H__
+
+#include <stdio.h>
+
+/* Latency histograms, in the style of HdrHistogram. Values below
+   2 * HISTOGRAM_SUB_BUCKETS each have their own bucket, and above that
+   each power of two is divided into HISTOGRAM_SUB_BUCKETS buckets, so
+   any value is recorded to within about 3%, in a fixed table of counts
+   which threads can update without a lock. Values are in
+   nanoseconds. */
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct histogram {
+    unsigned long counts[HISTOGRAM_BUCKETS];
+    unsigned long count;
+    unsigned long long total;
+    unsigned long long max;
+} Histogram;
+
+void record_value( Histogram *histogram, unsigned long long value );
+
+unsigned long long value_at_percentile( Histogram *histogram, double percentile );
+
+/* The phases of expanding a command which are timed, once timing has
+   been turned on. Each request's time in each phase is added up, and
+   recorded in the phase's histogram when the request is done, so the
+   histograms show how long requests spent in each phase. Only a
+   sample of the requests is timed, so the counts are of the requests
+   in the sample. A phase which a request didn't reach isn't recorded
+   at all. The post phase is the final pass over the expanded command,
+   and includes the back-ticks phase, the expansion of any commands
+   within back-ticks. */
+
+typedef enum {
+    PHASE_REQUEST,
+    PHASE_TABLE,
+    PHASE_SPLIT,
+    PHASE_HISTORY,
+    PHASE_BACK_TICKS,
+    PHASE_POST,
+    N_PHASES
+} Phase;
+
+void enable_phase_timing( void );
+
+void start_request_timing( void );
+
+void end_request_timing( void );
+
+unsigned long long start_phase( void );
+
+void end_phase( Phase phase, unsigned long long start );
+
+void print_phase_stats( FILE *f );
+
+
+#endif /* __STATS_SUPPORT_H__ */
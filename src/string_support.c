@@ -24,18 +24,33 @@
 
 #include "string_support.h"
 #include "list_support.h"
+#include "allocator_support.h"
 
 /* Append a string to a string which is stored in memory allocated by
    malloc. (Often a string returned by strdup or strndup.) */
 
 char *append_dup_string( char *s, char *suffix )
 {
-    s = realloc( s, (strlen(s) + strlen(suffix) + 1) );
+    s = reallocate( s, (strlen(s) + strlen(suffix) + 1) );
     strcat( s, suffix );
 
     return s;
 }
 
+/* Append the first length characters of a string to a string which
+   is stored in memory allocated by malloc. */
+
+char *append_substring( char *s, char *suffix, size_t length )
+{
+    size_t s_length = strlen( s );
+
+    s = reallocate( s, s_length + length + 1 );
+    memcpy( &(s[s_length]), suffix, length );
+    s[s_length + length] = '\0';
+
+    return s;
+}
+
 /* Create a copy of a part of a string. The beginning and end of the
    substring can be specified relative to the start or end of the
    string. 
@@ -87,9 +102,9 @@ char *slice( char *s, int relative_begin, int relative_end )
     }
 
     if ( absolute_begin < absolute_end ) {
-        result = strndup( &(s[absolute_begin]), absolute_end - absolute_begin );
+        result = copy_substring( &(s[absolute_begin]), absolute_end - absolute_begin );
     } else {
-        result = strdup( "" );
+        result = copy_string( "" );
     }
 
     return result;
@@ -141,7 +156,7 @@ List *split( char *text, char *delimiters )
        word. The word can't be longer than longer than the string that
        we are splitting. */
 
-    buffer = malloc( length + 1 );
+    buffer = allocate( length + 1 );
     p = buffer;
 
     for ( i = 0; i < length; i++ ) {
@@ -159,7 +174,7 @@ List *split( char *text, char *delimiters )
                so if there is a word stored in the buffer, append it
                to the list. */
             *p = '\0';
-            result = append_to_list( result, strdup( buffer ) );
+            result = append_to_list( result, copy_string( buffer ) );
             p = buffer;
         }
     }
@@ -168,10 +183,10 @@ List *split( char *text, char *delimiters )
        in the buffer to the list. */
     if ( p != buffer ) {
         *p = '\0';
-        result = append_to_list( result, strdup( buffer ) );
+        result = append_to_list( result, copy_string( buffer ) );
     }
 
-    free( buffer );
+    deallocate( buffer );
     return result;
 }
 
@@ -197,7 +212,7 @@ char *trim( char *s )
 
     result = slice( s, begin, (end+1) );
 
-    free( s );
+    deallocate( s );
     return ( result );
 }
 
@@ -215,7 +230,7 @@ static char *get_enclosed_string( char *s, char left, char right )
 
     if ( (s[0] == left) && (s[length-1] == right) ) {
         result = slice( s, 1, -1 );
-        free( s );
+        deallocate( s );
     } else {
         result = s;
     }
@@ -243,31 +258,37 @@ char *get_string_in_quotes( char *string )
     return get_enclosed_string( string, '"', '"' );
 }
 
-/* Remove quotes (") from a string, unless they are escaped with a
-   backslash. */
+/* Remove quotes (") from the first length bytes of s where they lie,
+   unless they are escaped with a backslash. Returns the new length. */
 
-char *remove_quotes( char *s )
+size_t remove_quotes_in_place( char *s, size_t length )
 {
-    size_t length = strlen(s);
-    char *result = malloc( length + 1 );
-    int i = 0;
-    int j = 0;
+    size_t i = 0;
+    size_t j = 0;
 
     while ( i < length ) {
-        if ( s[i] == '\\' ) {
-            result[j++] = s[i++];
-            result[j++] = s[i++];
+        if ( (s[i] == '\\') && (i + 1 < length) ) {
+            s[j++] = s[i++];
+            s[j++] = s[i++];
         } else if ( s[i] == '"' ) {
             i++;
         } else {
-            result[j++] = s[i++];
+            s[j++] = s[i++];
         }
     }
 
-    result[j] = '\0';
+    return j;
+}
 
-    free( s );
-    return result;
+/* Remove quotes (") from a string, unless they are escaped with a
+   backslash. */
+
+char *remove_quotes( char *s )
+{
+    size_t length = remove_quotes_in_place( s, strlen(s) );
+
+    s[length] = '\0';
+    return s;
 }
 
 /* Return a new copy of a string with any \<character> converted to
@@ -276,7 +297,7 @@ char *remove_quotes( char *s )
 char *remove_backslash( char *s, char character )
 {
     size_t length = strlen(s);
-    char *result = malloc( length + 1 );
+    char *result = allocate( length + 1 );
     int i = 0;
     int j = 0;
 
@@ -294,6 +315,38 @@ char *remove_backslash( char *s, char character )
 
     result[j] = '\0';
 
-    free( s );
+    deallocate( s );
     return result;
 }
+
+/* Convert a size such as "512", "64K", "100M" or "2G" into a number
+   of bytes. Returns zero if the string isn't a valid size. */
+
+size_t parse_size( char *s )
+{
+    char *end;
+    unsigned long long size = strtoull( s, &end, 10 );
+
+    if ( end == s ) {
+        return 0;
+    }
+
+    switch ( toupper( *end ) ) {
+    case 'G':
+        size *= 1024;
+        /* fall through */
+    case 'M':
+        size *= 1024;
+        /* fall through */
+    case 'K':
+        size *= 1024;
+        end++;
+        break;
+    }
+
+    if ( *end != '\0' ) {
+        return 0;
+    }
+
+    return size;
+}
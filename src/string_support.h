@@ -16,13 +16,23 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stddef.h>
+
 #include "list_support.h"
 
 #ifndef __STRING_SUPPORT_H__
 #define __STRING_SUPPORT_H__
 
+/* Functions which return a new string, in memory allocated by malloc,
+   leave their arguments alone, unless they say otherwise. Those such
+   as append_dup_string() and trim() which take over a string, freeing
+   or reallocating it, are always given one which was allocated by
+   malloc, and the caller must use the result in its place. */
+
 char *append_dup_string( char *s, char *suffix );
 
+char *append_substring( char *s, char *suffix, size_t length );
+
 char *slice( char *s, int relative_begin, int relative_end );
 
 List *split( char *text, char *delimiters );
@@ -36,9 +46,13 @@ char *get_string_in_brackets( char *string );
 char *get_string_in_quotes( char *string );
 
 
+size_t remove_quotes_in_place( char *s, size_t length );
+
 char *remove_quotes( char *s );
 
 char *remove_backslash( char *s, char character );
 
+size_t parse_size( char *s );
+
 
 #endif /* __STRING_SUPPORT_H__ */
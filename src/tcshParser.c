@@ -32,769 +32,526 @@
 #include <error.h>
 #include <errno.h>
 #include <err.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include "list_support.h"
 #include "string_support.h"
 #include "alias_support.h"
+#include "dealias_support.h"
+#include "cache_support.h"
+#include "server_support.h"
+#include "client_support.h"
+#include "batch_support.h"
+#include "script_support.h"
+#include "aggregate_support.h"
+#include "emit_support.h"
+#include "disk_cache_support.h"
+#include "allocator_support.h"
 
-/* Any character in the white_space string will be taken to delimit
-   words in an alias. */
 
-char *white_space = " \f\n\r\t\v";
+/* The default permissions of a server's Unix domain socket. */
 
-/* Read the contents of the alias file into memory. The alias file
-   contains one line for each alias which has been defined. The first
-   word on the line is the alias, and the rest of the line what the
-   alias expands to. */
+#define DEFAULT_SOCKET_MODE 0600
 
-Alias *read_alias_table( char *alias_file )
-{
-    FILE *f;
-    char *line = NULL;
-    size_t buffer_size = 0;
-    ssize_t n;
-    Alias *result = NULL;
-    List *words;
-    char *lhs;
-    char *rhs;
-
-    f = fopen( alias_file, "r" );
-    if ( f != NULL ) {
-        while ( (n = getline( &line, &buffer_size, f )) > 0 ) {
+/* The default memory limit for the tables cached by a server. */
 
-            /* When reading a file using getline, we are given the '\n' characters, 
-               but in this case we're not interested in them. */
+#define DEFAULT_CACHE_SIZE (64 * 1024 * 1024)
 
-            if ( (n > 0) && (line[n-1] == '\n') ) {
-                line[n-1] = '\0';
-            }
-
-            /* Splitting the line between the first and second words, gives us the 
-               alias and what it should expand to. */
+/* A single command line with at least this many simple commands is
+   expanded by a pool of threads. */
 
-            words = split_after_first_word( line );
+#define DEFAULT_PARALLEL_COMMANDS 1000
 
-            if ( list_length( words ) == 2 ) {
-                lhs = get_nth_word( words, 0 );
-                rhs = get_nth_word( words, 1 );
+/* How many of the most common commands -aggregate reports, and how
+   many distinct ones it counts exactly. */
 
-                /* What the alias expands to is often enclosed in
-                   "()", but we don't need the brackets. Similary we
-                   can strip out any unescaped quotes, i.e. '"'.*/
+#define DEFAULT_TOP 20
+#define DEFAULT_MAX_DISTINCT 100000
 
-                rhs = get_string_in_brackets( rhs );
-                rhs = remove_quotes( rhs );
+/* The aliases compiled into the program by -emit-c, if there are any
+   (see emit_support.h). */
 
-                result = new_alias( result, lhs, rhs );
-            } else {
-                fprintf( stderr, "Ignoring unexpected entry in alias table: %s\n", line );
-            }
+extern AliasTable builtin_aliases __attribute__((weak));
 
-            free_list( words );
-        }
-
-        free( line );
-        fclose( f );
-    } else {
-        warn( "Unable to open file %s", alias_file );
-    }
-
-    return result;
-}
-
-
-/* A command is considered "empty" if it either of zero length or
-   contains only white-space characters. */
-
-int is_empty( char *command )
+static void usage( char *program )
 {
-    while ( *command != '\0' && isspace( *command ) ) {
-        command++;
-    }
-
-    if ( *command == '\0' ) {
-        return 1;
-    } else {
-        return 0;
-    }
+    fprintf( stderr, "\nTake a tcsh alias table and a tcsh command and print the command after\n" );
+    fprintf( stderr, "alias substitution. The alias table can be created from within tcsh by:\n" );
+    fprintf( stderr, "  alias > alias.txt\n\n" );
+
+    fprintf( stderr, "usage: %s [options] <alias-table> <cmd args ...>\n", program );
+    fprintf( stderr, "       %s -batch [-threads <n>] <alias-table> < commands\n", program );
+    fprintf( stderr, "       %s -script <alias-table> <script>\n", program );
+    fprintf( stderr, "       %s -aggregate [-names] [-top <n>] [-max-distinct <n>] [-threads <n>]\n"
+                     "           <alias-table> < commands\n", program );
+    fprintf( stderr, "       %s -server <socket> [-cache-size <size>] [-socket-mode <mode>]\n"
+                     "           [-threads <n>]\n", program );
+    fprintf( stderr, "       %s -emit-c <alias-table> > aliases.c\n\n", program );
+    fprintf( stderr, "options:\n" );
+    fprintf( stderr, "  -stats              print alias table statistics to stderr, or with -client\n" );
+    fprintf( stderr, "                      and nothing else, print the server's statistics\n" );
+    fprintf( stderr, "  -argv               take each of <cmd args ...> as a single word, already\n" );
+    fprintf( stderr, "                      split up and unquoted by the calling shell\n" );
+    fprintf( stderr, "  -0                  print the words of the expanded command, each followed\n" );
+    fprintf( stderr, "                      by a NUL character, e.g. for xargs -0\n" );
+    fprintf( stderr, "  -cache              keep expanded commands in a cache under $XDG_CACHE_HOME\n" );
+    fprintf( stderr, "  -cache-dir <dir>    keep expanded commands in a cache in <dir>\n" );
+    fprintf( stderr, "  -memory <size>      expand the command within a fixed buffer of <size> bytes\n" );
+    fprintf( stderr, "  -parallel <n>       expand a command of at least <n> simple commands using\n" );
+    fprintf( stderr, "                      a pool of threads, or never if <n> is 0 (default %d)\n",
+             DEFAULT_PARALLEL_COMMANDS );
+    fprintf( stderr, "  -max-output <size>  fail to expand a command whose expansion is longer than\n" );
+    fprintf( stderr, "                      <size>, or 0 for no limit (default %dM)\n",
+             DEFAULT_MAX_OUTPUT / (1024 * 1024) );
+    fprintf( stderr, "  -max-steps <n>      fail to expand a command which takes more than <n> steps,\n" );
+    fprintf( stderr, "                      or 0 for no limit (default %d)\n", DEFAULT_MAX_STEPS );
+    fprintf( stderr, "  -max-time <seconds> fail to expand a command which takes longer than\n" );
+    fprintf( stderr, "                      <seconds>, or 0 for no limit (default %d)\n",
+             DEFAULT_MAX_SECONDS );
+    fprintf( stderr, "  -batch              expand each line of the standard input as a command\n" );
+    fprintf( stderr, "  -script             expand the aliases in a whole tcsh script\n" );
+    fprintf( stderr, "  -aggregate          expand each line of the standard input as a command, and\n" );
+    fprintf( stderr, "                      print the most common expanded commands with counts\n" );
+    fprintf( stderr, "  -names              with -aggregate, count the names of the commands instead\n" );
+    fprintf( stderr, "  -top <n>            with -aggregate, how many to print (default %d)\n",
+             DEFAULT_TOP );
+    fprintf( stderr, "  -max-distinct <n>   with -aggregate, count at most <n> distinct commands\n" );
+    fprintf( stderr, "                      exactly, and estimate beyond that (default %d)\n",
+             DEFAULT_MAX_DISTINCT );
+    fprintf( stderr, "  -emit-c             write the alias table out as C source, to be built into\n" );
+    fprintf( stderr, "                      the program with \"make tcshParser-site\"\n" );
+    fprintf( stderr, "  -client <socket>    ask the server listening on <socket> to expand the command\n" );
+    fprintf( stderr, "  -server <socket>    expand commands for clients connecting to <socket>\n" );
+    fprintf( stderr, "  -cache-size <size>  memory limit for the server's alias tables, e.g. 64M\n" );
+    fprintf( stderr, "  -socket-mode <mode> permissions of the server's Unix domain socket, in octal\n" );
+    fprintf( stderr, "                      (default %03o)\n", DEFAULT_SOCKET_MODE );
+    fprintf( stderr, "  -threads <n>        number of server or batch expansion threads, or 0 for\n" );
+    fprintf( stderr, "                      one per processor (the default for -batch), or of\n" );
+    fprintf( stderr, "                      extra threads for -parallel\n" );
+    fprintf( stderr, "\nAn <alias-table> of -noalias means no aliases at all, and -builtin the aliases\n" );
+    fprintf( stderr, "built into the program.\n" );
+    fprintf( stderr, "\nA <socket> is either the path of a Unix domain socket or a TCP host:port.\n" );
 }
 
-/* Return a string representing words n through to m from the alias
-   and its arguments. By analogy with conventional command line
-   processing, argument zero is taken to mean the name of the alias,
-   and arguments 1 to length are the actual arguments. */
+/* Read the aliases named on the command line: none at all for
+   "-noalias", those built into the program for "-builtin", and
+   otherwise those in a file, which is mapped rather than read if
+   is_brief says that we're about to exit (see map_alias_table()). */
 
-char *arg_substring(int n, int m, char *alias, char *args)
+static AliasTable *load_alias_table( char *alias_file, int is_brief )
 {
-    List *arg_array;
-    int length;
-    int first_arg;
-    int i;
-    char *result;
-
-    /* Split the "args" character string into a list of words
-       delimited by white space. */
-
-    arg_array = split( args, white_space );
-    length = list_length( arg_array );
-
-    // fprintf( stderr, "arg_substring( %d, %d, %s, %s )\n", n, m, alias, args );
-
-    if ( (n <= m) && (m <= length) ) {
-        if ( n == 0 ) {
-            result = strdup( alias );
-            first_arg = 1;
-        } else {
-            result = strdup( "" );
-            first_arg = n;
+    if ( strcmp( alias_file, "-noalias" ) == 0 ) {
+        return NULL;
+    } else if ( strcmp( alias_file, "-builtin" ) == 0 ) {
+        if ( &builtin_aliases == NULL ) {
+            errx( 1, "No aliases are built into this program" );
         }
-
-        for ( i = first_arg; i <= m; i++ ) {
-            result = append_dup_string( result, " " );
-            result = append_dup_string( result, get_nth_word( arg_array, i-1 ) );
-        }
-
-        result = trim( result );
+        return &builtin_aliases;
+    } else if ( is_brief ) {
+        return map_alias_table( alias_file );
     } else {
-        result = strdup( "" );
+        return read_alias_table( alias_file );
     }
-
-    //fprintf( stderr, "arg_substring returns '%s'\n", result );
-
-    return result;
 }
 
-/* Returns a copy of any sequence of digits from the start of a
-   string. */
+/* Ask a server to expand the command. The server has a different
+   working directory from us, so it needs the full path of the alias
+   file. */
 
-char *get_integer( char *string )
+static char *client_dealias( char *socket_path, char *alias_file, char *command,
+                             size_t length, int flags, size_t *result_length )
 {
-    int i = 0;
-    int length = strlen( string );
+    char path[PATH_MAX];
     char *result;
 
-    while ( (i < length) && isdigit( string[i] ) ) {
-        i++;
+    if ( strcmp( alias_file, "-noalias" ) == 0 ) {
+        strcpy( path, alias_file );
+    } else if ( strcmp( alias_file, "-builtin" ) == 0 ) {
+        warnx( "A server can't use the aliases built into the client" );
+        return NULL;
+    } else if ( realpath( alias_file, path ) == NULL ) {
+        warn( "Unable to open file %s", alias_file );
+        return NULL;
     }
 
-    if ( i > 0 ) {
-        result = slice( string, 0, i );
-    } else {
-        result = NULL;
-    }
+    /* The EXPAND_ flags are carried by the matching REQUEST_ flags. */
+
+    result = request_expansion( socket_path, path, command, length,
+                                ((flags & EXPAND_ARGV) ? REQUEST_ARGV : 0) |
+                                ((flags & EXPAND_NUL_WORDS) ? REQUEST_NUL_WORDS : 0),
+                                result_length );
 
     return result;
 }
 
-/* Before tcsh processes aliases, it stores the current command in the
-   "history", so that an alias can use history processing commands on
-   it. So, in the context of this program, "history" means the current
-   command, rather than the commands that you typed before this
-   one. */
+/* Print an expanded command, either as a line or, with
+   EXPAND_NUL_WORDS, as it is. It is written straight to the standard
+   output, so that a one-shot run never has to set up stdio. */
 
-char *replace_history( char *cmd, char *alias, char *args )
+static void print_result( const char *result, size_t length, int flags )
 {
-    int start_index = 0;
-    int curr_index = 0;
-    char *result = strdup( "" );
-    List *arg_list;
-    int num_args;
-    int cmd_length = strlen( cmd );
-
-    //fprintf( stderr, "replace_history( (%s),(%s),(%s) )\n", cmd, alias, args );
-
-    char *m_string;
-    char *n_string;
-
-    //if we don't find a history pattern we just shove the args at the end.
-    int found = 0;
-
-    /* Split args into a list of words */
-
-    arg_list = split( args, white_space );
-    num_args = list_length( arg_list );
-
-    /* We are looking for patterns which start with a '!'. The '!' is
-       always followed by one or more characters, so there is no point
-       in looking past the penultimate character. */
-
-    while ( curr_index < (cmd_length - 1) ) {
-        if ( cmd[curr_index] == '!' ) {
-            int n = -1; //not set
-            int m = -1; //not set
-            curr_index++;
-
-            int pattern_size = 0;
-            int found_colon = 0;
-            if ( cmd[curr_index] == ':' ) {
-                curr_index++;
-                found_colon = 1;
-            }
+    struct iovec parts[2];
+    int i = 0;
+    ssize_t n;
 
-            switch(cmd[curr_index]) {
-            case '!':
-            case '#':
-                /* "!!" means the previous event while "!#" means the
-                   current event, but for our purposes the two are
-                   equivalent. */
-                found = 1;
-                n = 0;
-                m = num_args;
-                pattern_size = 1;
-                break;
-
-            case '*': /* "!*" means all the arguments, but returns nothing if there are no args. */
-                found = 1;
-                n = 1;
-                m = num_args;
-                pattern_size = 1;
-                break;
-
-            case '$': /* "!$" means the final argument */
-                found = 1;
-                n = num_args;
-                m = num_args;
-                pattern_size = 1;
-                break;
-
-            case '^': /* "!^" means the first argument */
-                found = 1;
-                n = 1;
-                /* If the next character is '-', then we have a range 
-                   starting with the first arg. */
-
-                if (cmd[curr_index + 1] == '-') {
-                    m_string = get_integer( &(cmd[curr_index+2]) );
-                    if (m_string != NULL) { //"!:^-m
-                        pattern_size = strlen( m_string ) + 2;
-                        m = atoi( m_string );
-                        free( m_string );
-                    } else if ( cmd[curr_index+2] == '$' ) {
-                        pattern_size = 3;
-                        m = num_args;
-                    } else { 
-                        /* A "!:^-" without a following number implies all 
-                           args but last, equivalent to "!:1-" */
-                        pattern_size = 2;
-                        m = num_args-1;
-                    }
-                } else {
-                    pattern_size = 1;
-                    m = 1;
-                }
-                break;
-
-            case '-':
-                /* If a "range" starts with a '-', then the range
-                   implicitly starts at zero. */
-                found = 1;
-                n = 0;
-                m_string = get_integer( &(cmd[curr_index+1]) );
-                if (m_string != NULL) {
-                    pattern_size = strlen(m_string) + 1;
-                    m = atoi(m_string);
-                    free( m_string );
-                } else if (cmd[curr_index + 1] == '$') {
-                    //"!:-$" implies all
-                    pattern_size = 2;
-                    m = num_args;
-                } else {
-                    //"!:-" implies all but last, equivalent to "!:0-"
-                    pattern_size = 1;
-                    m = num_args-1;
-                }
-                break;
-
-            default:
-                if ( found_colon ) {
-                    found = 1;
-                    n_string = get_integer( &(cmd[curr_index]) );
-                    if (n_string != NULL) {
-                        //found "!:n... "
-                        pattern_size = strlen( n_string );
-                        n = atoi( n_string );
-                        free( n_string );
-
-                        switch(cmd[curr_index + pattern_size]) {
-                        case '*': /* Equivalent to !:n-$ */
-                            m = num_args;
-                            pattern_size++;
-                            break;
-
-                        case '-':
-                            pattern_size++;
-                            m_string = get_integer( &(cmd[curr_index+pattern_size]) );
-                            if (m_string != NULL) {
-                                //"!:n-m"
-                                pattern_size += strlen( m_string );
-                                m = atoi( m_string );
-                                free( m_string );
-                            } else if ( cmd[curr_index+pattern_size] == '$' ) {
-                                m = num_args;
-                                pattern_size++;
-                            } else {
-                                //"!:n-" implies all but last
-                                m = num_args-1;
-                            }
-                            break;
-
-                        default:
-                            //just "!:n"
-                            m = n;
-                            break;
-                        }
-                    } else {
-                        //"!:" is the same as "!#"
-                        n = 0;
-                        m = num_args;
-                        pattern_size = 1;
-                    }
-                }
-                break;
-            }
+    parts[0].iov_base = (char *) result;
+    parts[0].iov_len = length;
+    parts[1].iov_base = "\n";
+    parts[1].iov_len = (flags & EXPAND_NUL_WORDS) ? 0 : 1;
 
-            if ( pattern_size != 0 ) {
-                int length;
-                if ( found_colon ) {
-                    length = curr_index - start_index - 2;
-                } else {
-                    length = curr_index - start_index - 1;
-                }
-                result = append_dup_string( result,
-                                            strndup( &(cmd[start_index]), length ) );
-
-                result = append_dup_string( result, arg_substring(n, m, alias, args) );
-                curr_index += pattern_size;
-                start_index = curr_index;
+    while ( i < 2 ) {
+        n = writev( STDOUT_FILENO, &(parts[i]), 2 - i );
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
             }
-
-        } else { // not '!'
-            curr_index++;
+            return;
         }
-    }
 
-    if ( start_index < cmd_length ) {
-        result = append_dup_string( result, &(cmd[start_index]) );
+        while ( (i < 2) && ((size_t) n >= parts[i].iov_len) ) {
+            n -= parts[i].iov_len;
+            i++;
+        }
+        if ( i < 2 ) {
+            parts[i].iov_base = (char *) parts[i].iov_base + n;
+            parts[i].iov_len -= n;
+        }
     }
+}
 
-    /* If we didn't find any history substitutions in the whole
-       string, then simply append the args. */
-    if ( !found ) {
-        result = append_dup_string( result, " " );
-        result = append_dup_string( result, args );
-    }
+/* The buffer that -memory expands a command within, and the memory
+   that it was given, which may start before the buffer does so that
+   the buffer is aligned. It is released when we exit, once nothing
+   more can be deallocated from it. */
 
-    result = trim( result );
+static FixedBuffer fixed_buffer;
+static void *fixed_memory;
 
-    //fprintf( stderr, "replace_history returns (%s)\n", result );
-    return result;
+static void release_fixed_buffer( void )
+{
+    set_allocator( NULL );
+    free( fixed_memory );
 }
 
-/* Break up a string into a list of simple commands */
 
-List *split_into_simple_commands( char *cmd )
+int main( int argc, char *argv[] )
 {
-    List *command_list = NULL;
-
-    int escaped = 0;
-    int in_single_quote = 0;
-    int in_double_quote = 0;
-    int in_backwards_quote = 0;
-
-    int start_index = 0;
-    int current_index = 0;
-    int cmd_length = strlen( cmd );
-    char c;
-    char prev_c;
-    char next_c;
-
-    //fprintf( stderr, "split_into_simple_commands(%s)\n", cmd );
-
-    while ( current_index < cmd_length ) {
-        /* It is sometimes easiest if we can look one character to the
-           right or to the left of the current position, whilst not
-           going off either end of the string. */
-
-        c = cmd[ current_index ];
-
-        if ( current_index > 0 ) {
-            prev_c = cmd[ current_index - 1 ];
-        } else {
-            prev_c = '\0';
-        }
-
-        if ( (current_index + 1) < cmd_length ) {
-            next_c = cmd[ current_index + 1 ];
+    AliasTable *aliases = NULL;
+    char *cmd;
+    size_t length;
+    int i;
+    char *result;
+    size_t result_length;
+    int flags = 0;
+    char *cache_directory = NULL;
+    char *default_directory = NULL;
+    int use_default_directory = 0;
+    size_t memory_size = 0;
+    int parallel_commands = DEFAULT_PARALLEL_COMMANDS;
+    ThreadPool *pool = NULL;
+    DiskCache *disk_cache = NULL;
+    unsigned long long file_hash = 0;
+    const char *cached;
+    int arg = 1;
+    int show_stats = 0;
+    char *client_socket = NULL;
+    char *server_socket = NULL;
+    size_t cache_size = DEFAULT_CACHE_SIZE;
+    mode_t socket_mode = DEFAULT_SOCKET_MODE;
+    int n_threads = -1;
+    int batch = 0;
+    int script = 0;
+    int aggregate = 0;
+    int emit_c = 0;
+    int by_name = 0;
+    int top = DEFAULT_TOP;
+    int max_distinct = DEFAULT_MAX_DISTINCT;
+    size_t max_output = DEFAULT_MAX_OUTPUT;
+    unsigned long max_steps = DEFAULT_MAX_STEPS;
+    double max_seconds = DEFAULT_MAX_SECONDS;
+    int status;
+
+    /* Any options come before the alias table. */
+
+    while ( (arg < argc) && (argv[arg][0] == '-') &&
+            (strcmp( argv[arg], "-noalias" ) != 0) && (strcmp( argv[arg], "-builtin" ) != 0) ) {
+        if ( strcmp( argv[arg], "-stats" ) == 0 ) {
+            show_stats = 1;
+        } else if ( strcmp( argv[arg], "-argv" ) == 0 ) {
+            flags |= EXPAND_ARGV;
+        } else if ( strcmp( argv[arg], "-0" ) == 0 ) {
+            flags |= EXPAND_NUL_WORDS;
+        } else if ( strcmp( argv[arg], "-cache" ) == 0 ) {
+            use_default_directory = 1;
+        } else if ( (strcmp( argv[arg], "-cache-dir" ) == 0) && (arg + 1 < argc) ) {
+            cache_directory = argv[++arg];
+            use_default_directory = 0;
+        } else if ( (strcmp( argv[arg], "-memory" ) == 0) && (arg + 1 < argc) &&
+                    ((memory_size = parse_size( argv[arg+1] )) > 0) ) {
+            arg++;
+        } else if ( (strcmp( argv[arg], "-max-output" ) == 0) && (arg + 1 < argc) &&
+                    ((strcmp( argv[arg+1], "0" ) == 0) ||
+                     ((max_output = parse_size( argv[arg+1] )) > 0)) ) {
+            if ( strcmp( argv[++arg], "0" ) == 0 ) {
+                max_output = 0;
+            }
+        } else if ( (strcmp( argv[arg], "-max-steps" ) == 0) && (arg + 1 < argc) ) {
+            max_steps = strtoul( argv[++arg], NULL, 10 );
+        } else if ( (strcmp( argv[arg], "-max-time" ) == 0) && (arg + 1 < argc) ) {
+            max_seconds = atof( argv[++arg] );
+        } else if ( (strcmp( argv[arg], "-parallel" ) == 0) && (arg + 1 < argc) ) {
+            parallel_commands = atoi( argv[++arg] );
+        } else if ( strcmp( argv[arg], "-batch" ) == 0 ) {
+            batch = 1;
+        } else if ( strcmp( argv[arg], "-script" ) == 0 ) {
+            script = 1;
+        } else if ( strcmp( argv[arg], "-aggregate" ) == 0 ) {
+            aggregate = 1;
+        } else if ( strcmp( argv[arg], "-emit-c" ) == 0 ) {
+            emit_c = 1;
+        } else if ( strcmp( argv[arg], "-names" ) == 0 ) {
+            by_name = 1;
+        } else if ( (strcmp( argv[arg], "-top" ) == 0) && (arg + 1 < argc) ) {
+            top = atoi( argv[++arg] );
+        } else if ( (strcmp( argv[arg], "-max-distinct" ) == 0) && (arg + 1 < argc) ) {
+            max_distinct = atoi( argv[++arg] );
+        } else if ( (strcmp( argv[arg], "-client" ) == 0) && (arg + 1 < argc) ) {
+            client_socket = argv[++arg];
+        } else if ( (strcmp( argv[arg], "-server" ) == 0) && (arg + 1 < argc) ) {
+            server_socket = argv[++arg];
+        } else if ( (strcmp( argv[arg], "-threads" ) == 0) && (arg + 1 < argc) ) {
+            n_threads = atoi( argv[++arg] );
+        } else if ( (strcmp( argv[arg], "-cache-size" ) == 0) && (arg + 1 < argc) &&
+                    ((cache_size = parse_size( argv[arg+1] )) > 0) ) {
+            arg++;
+        } else if ( (strcmp( argv[arg], "-socket-mode" ) == 0) && (arg + 1 < argc) ) {
+            socket_mode = strtol( argv[++arg], NULL, 8 ) & 0777;
         } else {
-            next_c = '\0';
+            fprintf( stderr, "Unknown option: %s\n", argv[arg] );
+            usage( argv[0] );
+            return 1;
         }
+        arg++;
+    }
 
-        switch(c) {
-        case '\\' :
-            escaped = 1;
-            current_index++;
-            break;
-
-        case '\'' :
-            if ( escaped ) {
-                escaped = 0;
-                current_index++;
-            } else {
-                in_single_quote = !in_single_quote;
-                current_index++;
-            }
-            break;
-
-        case '\"' :
-            if ( escaped ) {
-                escaped = 0;
-                current_index++;
-            } else {
-                in_double_quote = !in_double_quote;
-                current_index++;
-            }
-            break;
-
-        case '`' :
-            if ( escaped ) {
-                escaped = 0;
-                current_index++;
-            } else {
-                in_backwards_quote = !in_backwards_quote;
-                current_index++;
-            }
-            break;
-
-        case '|' :
-        case '&' :
-        case '(' :
-        case ')' :
-        case ';' :
-            escaped = 0;
-            if (in_single_quote || in_double_quote || in_backwards_quote) {
-                current_index++;
-            } else {
-                if ( ((c == '&') && (next_c == '&')) || 
-                     ((c == '|') && (next_c == '|')) ||
-                     ((c == '|') && (next_c == '&')) ) {
-                    command_list = append_to_list( command_list, 
-                                                   strndup( &(cmd[start_index]), current_index-start_index ) );
-                    command_list = append_to_list( command_list, 
-                                                   strndup( &(cmd[current_index]), 2 ) );
-                    current_index += 2;
-                    start_index = current_index;
-                } else if ( (prev_c == '>') && (c == '&') ) { // ignore >& redirect                    
-                    current_index++;
-                } else {
-                    command_list = append_to_list( command_list, 
-                                                   strndup( &(cmd[start_index]), current_index-start_index ) );
-                    command_list = append_to_list( command_list, 
-                                                   strndup( &(cmd[current_index]), 1 ) );
-                    current_index++;
-                    start_index = current_index;
-                }
-            }
-            break;
-
-        case ' ' :
-        case '\t' :
-            /* If we see one or more spaces or tabs at the start of a
-               (simple) command, then keep moving start_index forward,
-               so that if we eventually find a command, we've already
-               stepped over the white space. */
-
-            if (start_index == current_index) {
-                current_index++;
-                start_index = current_index;
-            } else {
-                current_index++;
-            }
-            escaped = 0;
-            break;
+    /* With -memory, everything is allocated from a single buffer, which
+       isn't thread safe. */
 
-        default :
-            escaped = 0;
-            current_index++;
+    if ( memory_size > 0 ) {
+        if ( batch || aggregate || (server_socket != NULL) ) {
+            fprintf( stderr, "The -memory option can't be used with -batch, -aggregate or -server\n" );
+            usage( argv[0] );
+            return 1;
         }
+        fixed_memory = malloc( memory_size );
+        if ( fixed_memory == NULL ) {
+            warn( "Unable to allocate %zu bytes for -memory", memory_size );
+            return 1;
+        }
+        set_allocator( init_fixed_buffer( &fixed_buffer, fixed_memory, memory_size ) );
+        atexit( release_fixed_buffer );
     }
 
-    if (start_index != current_index) {
-        command_list = append_to_list( command_list, 
-                                       strndup( &(cmd[start_index]), current_index-start_index ) );
+    set_expansion_limits( max_output, max_steps, max_seconds );
+
+    if ( use_default_directory ) {
+        default_directory = default_disk_cache_directory();
+        cache_directory = default_directory;
     }
 
-    //fprintf( stderr, "split_into_simple_commands returns\n" );
-    //print_list( command_list );
+    if ( server_socket != NULL ) {
+        return run_server( server_socket, new_table_cache( cache_size ),
+                           (n_threads < 0) ? 1 : n_threads, socket_mode );
+    }
 
-    return command_list;
-}
+    if ( emit_c && (argc == arg + 1) ) {
+        if ( strcmp( argv[arg], "-builtin" ) == 0 ) {
+            fprintf( stderr, "The -emit-c option needs an alias file\n" );
+            return 1;
+        }
+        if ( (strcmp( argv[arg], "-noalias" ) != 0) && (access( argv[arg], R_OK ) != 0) ) {
+            warn( "Unable to open file %s", argv[arg] );
+            return 1;
+        }
 
-/* Expand any aliases in a command, which should initially be a
-   "simple" command, although of course the process of expanding any
-   aliases may create sub-commands within it. */
+        aliases = load_alias_table( argv[arg], 1 );
+        if ( aliases == NULL ) {
+            aliases = new_alias_table();
+        }
 
-char *expand_aliases( char *command, int depth, Alias *aliases )
-{
-    int ends_with_space;
-    size_t length;
+        status = emit_alias_table( aliases, argv[arg], stdout );
+        free_alias_table( aliases );
+        deallocate( default_directory );
 
-    char *result;
-    char *cmd;
-    char *args;
+        return (status < 0);
+    }
 
-    int i;
-    List *words;
-    char *alias_value;
-    char *aliased_command;
-    char *prev_cmd;
-    List *new_command_list;
-    List *new_words;
-    int new_command_list_length;
-
-    // fprintf( stderr, "expand_aliases (%s),%d ... \n", command, depth );
-
-    /* If tcsh detects a loop in the aliases then it prints "Alias
-       loop", but we simply stop expanding aliases at a certain
-       depth. This is unlikely to affect any real alias expansion. */
-
-    if ( depth >= 20 ) {
-        result = strdup( command );
-    } else if ( is_empty( command ) ) {
-        result = strdup( command );
-    } else {
+    if ( (batch || aggregate) && (argc == arg + 1) ) {
+        aliases = load_alias_table( argv[arg], 0 );
 
-        /* If the command ends with a space, then we will eventually
-           make sure that the final result also ends with a space. */
-        length = strlen( command );
-        if ( (length > 0) && (command[length-1] == ' ') ) {
-            ends_with_space = 1;
+        if ( aggregate ) {
+            status = run_aggregate( 0, aliases, (n_threads < 0) ? 0 : n_threads, by_name,
+                                    top, max_distinct );
         } else {
-            ends_with_space = 0;
+            status = run_batch( 0, 1, aliases, (n_threads < 0) ? 0 : n_threads );
         }
 
-        /* Split the string at the first white space. The first entry
-           on the list is then the "command" and the second contains
-           all the arguments. */
-
-        words = split_after_first_word( command );
-        if ( list_length( words ) > 0 ) {
-            cmd = get_nth_word( words, 0 );
-            args = get_nth_word( words, 1 );
-            free_list( words );
-
-            /* If the command matches a defined alias, get the text which is is 
-               supposed to expand to. */
-
-            alias_value = lookup_alias( cmd, aliases );
-            if ( alias_value != NULL ) {
-                prev_cmd = strdup( cmd );
-
-                /* Replace refernces to the "history" with values from the 
-                   original command and arguments. */
+        if ( show_stats ) {
+            print_alias_stats( aliases );
+        }
 
-                aliased_command = replace_history( alias_value, cmd, args );
+        free_alias_table( aliases );
 
-                free( alias_value );
-                free( cmd );
+        return status;
+    }
 
-                /* Expanding the alias may very well have generated a number of 
-                   sub-commands, so we must again split into simple commands. */
+    if ( show_stats && (client_socket != NULL) && (argc == arg) ) {
+        result = request_expansion( client_socket, "-noalias", "", 0, REQUEST_STATS,
+                                    &result_length );
+        if ( result != NULL ) {
+            fwrite( result, 1, result_length, stdout );
+        }
+        deallocate( result );
+        deallocate( default_directory );
 
-                new_command_list = split_into_simple_commands( aliased_command );
-                new_command_list_length = list_length( new_command_list );
+        return (result == NULL);
+    }
 
-                result = get_nth_word( new_command_list, 0 );
+    if ( script && (argc == arg + 2) ) {
+        aliases = load_alias_table( argv[arg], 0 );
 
-                /* If the process so far has changed the command, then
-                   we need to see whether this new command is itself
-                   an alias. The simplest way to do this is to
-                   recursively call resolve_alias, but we include an
-                   explicit "depth" parameter so that we can avoid an
-                   infinite loop. */
+        status = run_script( argv[arg+1], 1, aliases );
 
-                new_words = split_after_first_word( aliased_command );
-                cmd = get_nth_word( new_words, 0 );
-                if ( strcmp( cmd, prev_cmd ) != 0 ) {
-                    result = expand_aliases( result, depth+1, aliases );
-                }
-                free_list( new_words );
+        if ( show_stats ) {
+            print_alias_stats( aliases );
+        }
 
-                free( aliased_command );
-                free( cmd );
-                free( prev_cmd );
+        free_alias_table( aliases );
+        deallocate( default_directory );
 
-                /* Recursively expand any aliases in the rest of the simple commands. */
+        return status;
+    }
 
-                for ( i = 1; i < new_command_list_length; i++ ) {
-                    result = append_dup_string( result, " " );
-                    cmd = expand_aliases( get_nth_word( new_command_list, i ), depth+1, aliases );
-                    result = append_dup_string( result, cmd );
-                    free( cmd );
-                }
+    if ( !script && !aggregate && !emit_c && (argc > arg) ) {
 
-                free_list( new_command_list );
+        /* Gather up all the rest of the args into a single string as
+           they form our command. With -argv, each of them stays a
+           separate word, ended by a '\0'. */
 
-                /* If the original command ended with a space, make
-                   sure that the result does as well. */
+        if ( flags & EXPAND_ARGV ) {
+            length = 0;
+            for ( i = arg+1; i < argc; i++ ) {
+                length += strlen( argv[i] ) + 1;
+            }
 
-                if ( ends_with_space ) {
-                    result = append_dup_string( result, " " );
-                }
-            } else {
-                /* The first word wasn't actually an alias. */
-                free( cmd );
-                result = strdup( command );
+            cmd = allocate( length + 1 );
+            length = 0;
+            for ( i = arg+1; i < argc; i++ ) {
+                strcpy( &cmd[length], argv[i] );
+                length += strlen( argv[i] ) + 1;
             }
         } else {
-            result = strdup( "" );
+            cmd = copy_string( "" );
+            for ( i = arg+1; i < argc; i++ ) {
+                cmd = append_dup_string( cmd, argv[i] );
+                cmd = append_dup_string( cmd, " " );
+            }
+            length = strlen( cmd );
         }
-    }
-
-    free( command );
-
-    // fprintf( stderr, "expand_aliases returns (%s)\n", result );
-
-    return result;
-}
-
-/* Expand aliases in a command, which is not necessarily a "simple"
-   command. */
-
-char *dealias_command( char *command, Alias *aliases )
-{
-    List *commands;
-    List *entry;
-    char *aliased_cmd;
-    char *result = strdup( "" );
-
-    /* Split the command into a list of simple commands. Expand any
-       aliases in each of these, and accumulate all of these into a
-       single string.*/
-
-    commands = split_into_simple_commands( command );
-
-    for ( entry = commands; entry != NULL; entry = entry->next ) {
-        aliased_cmd = expand_aliases( strdup( entry->contents ), 0, aliases );
-        result = append_dup_string( result, aliased_cmd );
-        free( aliased_cmd );
-    }
 
-    return result;
-}
-
-/* Any text within "back-ticks" is treated as a sub-command, and as such we need to 
-   expand any aliases it may contain. */
-
-char *process_back_ticks( char *command, Alias *aliases )
-{
-    List *words;
-    int n_words;
-    int i;
-    char *dealiased;
-    char *word;
-    char *result = strdup( "" );
-
-    /* Split the string into "words" using a back tick as the word
-       delimiter. The resulting "words" are not really words at all,
-       but represent sequences which are either "outside" or "inside"
-       backticks. */
-
-    words = split( command, "`" );
-    n_words = list_length( words );
-
-    for ( i = 0; i < n_words; i++ ) {
-        word = get_nth_word( words, i );
-
-        if ( (i % 2) == 0 ) {
-            /* Even numbered words are outside the back-ticks, and don't 
-               need any further processing. */
-            result = append_dup_string( result, word );
-        } else {
-            /* Odd numbered "words" were within back-ticks. Expand any
-               aliases within the sub-command and wrap the result up
-               in back-ticks. */
-            dealiased = dealias_command( word, aliases );
+        /* If the command is in the cache there's no need to look at
+           the aliases at all, just at the alias file's contents. The
+           aliases built into the program cost nothing to load, so
+           the cache isn't used with them. */
+
+        if ( cache_directory != NULL ) {
+            disk_cache = open_disk_cache( cache_directory );
+            if ( (disk_cache != NULL) &&
+                 ((strcmp( argv[arg], "-builtin" ) == 0) ||
+                  ((strcmp( argv[arg], "-noalias" ) != 0) &&
+                   (hash_alias_file( argv[arg], &file_hash ) != 0))) ) {
+                close_disk_cache( disk_cache );
+                disk_cache = NULL;
+            }
+        }
 
-            result = append_dup_string( result, "`");
-            result = append_dup_string( result, dealiased );
-            result = append_dup_string( result, "`");
+        cached = NULL;
+        result = NULL;
+        status = 0;
 
-            free( dealiased );
+        if ( (disk_cache != NULL) && !show_stats ) {
+            cached = find_expansion( disk_cache, file_hash, flags, cmd, length, &result_length );
         }
 
-        free( word );
-    }
+        if ( cached != NULL ) {
+            print_result( cached, result_length, flags );
+        } else if ( client_socket != NULL ) {
+            result = client_dealias( client_socket, argv[arg], cmd, length, flags,
+                                     &result_length );
+            if ( result == NULL ) {
+                status = 1;
+            }
+        } else {
 
-    free_list( words );
+            /* The first argument on the command line is usually the
+               name of the file containing the aliases, which we read
+               into memory. If however it is the string "-noalias",
+               then we operate without any alias definitions.  */
 
-    return result;
-}
+            aliases = load_alias_table( argv[arg], 1 );
 
+            // print_aliases( aliases );
 
-int main( int argc, char *argv[] )
-{
-    Alias *aliases;
-    char *cmd;
-    int i;
-    char *result;
+            /* A command of n simple commands has at least 2n - 1
+               characters, so only a long one can need the pool. The
+               fixed buffer isn't thread safe. */
 
-    if ( argc > 1 ) {
+            if ( (parallel_commands > 0) && (memory_size == 0) &&
+                 (length >= 2 * (size_t) parallel_commands - 1) ) {
+                pool = new_thread_pool( (n_threads <= 0) ? -1 : n_threads );
+                set_parallel_expansion( pool, parallel_commands );
+            }
 
-        /* The first argument on the command line is usually the name
-           of the file containing the aliases, which we read into
-           memory. If however it is the string "-noalias", then we
-           operate without any alias definitions.  */
+            result = expand_command_line( cmd, length, flags, aliases, &result_length );
+            if ( result == NULL ) {
+                warnx( "Unable to expand the command: %s", expansion_error_message( errno ) );
+                status = 1;
+            }
 
-        if ( strcmp( argv[1], "-noalias" ) == 0 ) {
-            aliases = NULL;
-        } else {
-            aliases = read_alias_table( argv[1] );
+            set_parallel_expansion( NULL, 0 );
+            free_thread_pool( pool );
         }
 
-        // print_aliases( aliases );
+        if ( result != NULL ) {
+            print_result( result, result_length, flags );
 
-        /* Gather up all the rest of the args into a single string as
-           they form our command */
-
-        cmd = strdup( "" );
-        for ( i = 2; i < argc; i++ ) {
-            cmd = append_dup_string( cmd, argv[i] );
-            cmd = append_dup_string( cmd, " " );
+            if ( disk_cache != NULL ) {
+                store_expansion( disk_cache, file_hash, flags, cmd, length, result, result_length );
+            }
         }
 
-        /* If the command is enclosed in double quotes then remove
-           the double quote from both ends. */
-
-        cmd = get_string_in_quotes( trim( cmd ) );
-
-        // fprintf( stderr, "Command is: %s\n", cmd );
-
-        result = dealias_command( cmd, aliases );
-
-        /* Any sub commands (contained in back ticks) may themselves
-           contain aliases which need to be expanded. */
-
-        result = process_back_ticks( result, aliases );
+        if ( disk_cache != NULL ) {
+            close_disk_cache( disk_cache );
+        }
 
-        /* Remove any quotes (") from the string, unless they are escaped 
-           with a backslash (\") */
+        deallocate( result );
 
-        result = remove_quotes( result );
+        deallocate( cmd );
 
-        /* Convert any occurence of "\!" into "!". */
-        result = remove_backslash( result, '!' );
+        if ( show_stats ) {
+            print_alias_stats( aliases );
+        }
 
-        printf( "%s\n", result );
-        free( result );
+        free_alias_table( aliases );
+        deallocate( default_directory );
 
-        free( cmd );
-    } else {
-        fprintf( stderr, "\nTake a tcsh alias table and a tcsh command and print the command after\n" );
-        fprintf( stderr, "alias substitution. The alias table can be created from within tcsh by:\n" );
-        fprintf( stderr, "  alias > alias.txt\n\n" );
-
-        fprintf( stderr, "usage: %s <alias-table> <cmd args ...>\n", argv[0] );
+        return status;
     }
 
+    usage( argv[0] );
+    deallocate( default_directory );
+
     return 0;
 }
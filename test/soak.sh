@@ -0,0 +1,174 @@
+#!/bin/bash
+#
+# This file is part of tcshParser.
+# Copyright (C) 2013 Ellexus (www.ellexus.com)
+#
+# tcshParser is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Expand millions of commands, in batch mode, as a script and then
+# through a server, and check that the memory used doesn't keep growing.
+#
+#     ./soak.sh [millions-of-commands]
+#
+# The server part needs the load generator, from "make loadgen". To
+# look for leaks with AddressSanitizer instead, build with
+# "make clean ; make CFLAGS='-g -pthread -fsanitize=address' LDFLAGS=-fsanitize=address",
+# and the batch run will fail if anything is leaked.
+
+SCRIPT_PATH=`readlink -f $0`
+TEST_PATH=`dirname $SCRIPT_PATH`
+
+PROGRAM=$TEST_PATH/../src/tcshParser
+LOADGEN=$TEST_PATH/../src/loadgen
+
+ALIAS_FILE=$TEST_PATH/test-aliases.txt
+
+MILLIONS=${1:-2}
+
+# Memory use may grow by this many kilobytes, once warmed up.
+
+ALLOWED_GROWTH=1024
+
+STATUS=0
+
+rss () {
+    awk '/^VmRSS:/ { print $2 }' /proc/$1/status 2>/dev/null
+}
+
+# Compare the memory used once warmed up with the most used since.
+
+report () {
+    local L_WHAT=$1
+    local L_WARM=$2
+    local L_PEAK=$3
+
+    if [ -z "$L_WARM" ] || [ -z "$L_PEAK" ]; then
+        echo "ERROR: $L_WHAT: no memory use measured"
+        STATUS=1
+    elif [ $((L_PEAK - L_WARM)) -gt $ALLOWED_GROWTH ]; then
+        echo "ERROR: $L_WHAT: memory grew from ${L_WARM}K to ${L_PEAK}K"
+        STATUS=1
+    else
+        echo "OK: $L_WHAT: memory ${L_WARM}K, at most ${L_PEAK}K"
+    fi
+}
+
+# Write an endless stream of commands, using every alias in the test
+# table with a few arguments, and some compound commands.
+
+commands () {
+    awk '{ corpus[NR] = $1 " one two \"three four\" five" }
+         END {
+             corpus[NR + 1] = "a 1 2 ; twice 3 4 && cdls /tmp | onepipeanother"
+             corpus[NR + 2] = "first `subinbacktick 1 2 3` || twolast 1 2 3 4 5"
+             corpus[NR + 3] = "gcc -O2 -c foo.c -o foo.o"
+             for ( ;; ) {
+                 for ( i = 1; i <= NR + 3; i++ ) {
+                     print corpus[i]
+                 }
+             }
+         }' $ALIAS_FILE
+}
+
+# Watch the memory used by a process until it finishes. It may take a
+# few seconds to reach its working size, so set WARM to the most memory
+# used in the first half of the run, and PEAK to the most used in the
+# second half.
+
+watch_memory () {
+    local L_PID=$1
+    local L_SAMPLES=()
+    local L_MEMORY
+    local L_HALF
+
+    while kill -0 $L_PID 2>/dev/null; do
+        L_MEMORY=$(rss $L_PID)
+        if [ -n "$L_MEMORY" ]; then
+            L_SAMPLES+=($L_MEMORY)
+        fi
+        sleep 0.2
+    done
+
+    L_HALF=$((${#L_SAMPLES[@]} / 2))
+    WARM=$(printf '%s\n' "${L_SAMPLES[@]:0:$L_HALF}" | sort -n | tail -1)
+    PEAK=$(printf '%s\n' "${L_SAMPLES[@]:$L_HALF}" | sort -n | tail -1)
+}
+
+# Batch mode.
+
+N_COMMANDS=$((MILLIONS * 1000000))
+
+$PROGRAM -batch $ALIAS_FILE < <(commands | head -n $N_COMMANDS) > /dev/null &
+PID=$!
+watch_memory $PID
+
+if ! wait $PID; then
+    echo "ERROR: batch: tcshParser failed"
+    STATUS=1
+fi
+report "batch, $N_COMMANDS commands" "$WARM" "$PEAK"
+
+# Script mode, where the whole script is mapped into memory, but the
+# parts which have been read should be given back.
+
+SCRIPT=$(mktemp)
+commands | head -n $N_COMMANDS > $SCRIPT
+
+$PROGRAM -script $ALIAS_FILE $SCRIPT > /dev/null &
+PID=$!
+watch_memory $PID
+
+if ! wait $PID; then
+    echo "ERROR: script: tcshParser failed"
+    STATUS=1
+fi
+report "script, $N_COMMANDS lines" "$WARM" "$PEAK"
+rm -f $SCRIPT
+
+# Server mode, with requests pipelined over a single connection.
+
+if [ -x $LOADGEN ]; then
+    SOCKET=$(mktemp -u)
+    $PROGRAM -server $SOCKET &
+    SERVER_PID=$!
+    trap "kill $SERVER_PID 2>/dev/null; rm -f $SOCKET" EXIT
+
+    while [ ! -S $SOCKET ]; do
+        sleep 0.1
+    done
+
+    # Each round sends its requests twice, one at a time and then
+    # pipelined.
+
+    ROUNDS=5
+    REQUESTS=$((N_COMMANDS / (2 * ROUNDS)))
+
+    $LOADGEN -pipeline 64 $SOCKET $ALIAS_FILE $REQUESTS > /dev/null
+    WARM=$(rss $SERVER_PID)
+    PEAK=$WARM
+
+    for ROUND in $(seq 2 $ROUNDS); do
+        $LOADGEN -pipeline 64 $SOCKET $ALIAS_FILE $REQUESTS > /dev/null
+        MEMORY=$(rss $SERVER_PID)
+        if [ "$MEMORY" -gt "$PEAK" ]; then
+            PEAK=$MEMORY
+        fi
+    done
+
+    report "server, $((2 * ROUNDS * REQUESTS)) requests" "$WARM" "$PEAK"
+else
+    echo "SKIPPED: server: no $LOADGEN, try \"make loadgen\""
+fi
+
+exit $STATUS
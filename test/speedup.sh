@@ -0,0 +1,82 @@
+#!/bin/bash
+#
+# This file is part of tcshParser.
+# Copyright (C) 2013 Ellexus (www.ellexus.com)
+#
+# tcshParser is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Time batch runs of a number of builds of tcshParser over a corpus of
+# commands, check that they all give the same output, and report how
+# much faster each one is than the first:
+#
+#     ./speedup.sh <alias-file> <commands> <program> <program> ...
+#
+# The commands are repeated COPIES times (2000 by default), so that
+# the run takes long enough to time, and each program is given the
+# best of RUNS runs (5 by default). "make pgo" in the src directory
+# uses this to compare the profile-guided build with the plain ones.
+
+ALIAS_FILE=$1
+COMMANDS=$2
+shift 2
+
+COPIES=${COPIES:-2000}
+RUNS=${RUNS:-5}
+
+if [ -z "$ALIAS_FILE" ] || [ -z "$COMMANDS" ] || [ $# -eq 0 ]; then
+    echo "usage: $0 <alias-file> <commands> <program> ..."
+    exit 1
+fi
+
+WORK=`mktemp -d`
+trap "rm -rf $WORK" EXIT
+
+for ((i = 0; i < COPIES; i++)); do
+    cat $COMMANDS
+done > $WORK/corpus
+
+echo "`wc -l < $WORK/corpus` commands, best of $RUNS runs:"
+
+STATUS=0
+FIRST_TIME=
+FIRST_PROGRAM=
+
+for PROGRAM in "$@"; do
+    BEST=
+    for ((i = 0; i < RUNS; i++)); do
+        START=`date +%s%N`
+        $PROGRAM -batch -threads 1 $ALIAS_FILE < $WORK/corpus > $WORK/output
+        END=`date +%s%N`
+        TIME=$(((END - START) / 1000000))
+        if [ -z "$BEST" ] || [ $TIME -lt $BEST ]; then
+            BEST=$TIME
+        fi
+    done
+    [ $BEST -gt 0 ] || BEST=1
+
+    if [ -z "$FIRST_TIME" ]; then
+        FIRST_TIME=$BEST
+        FIRST_PROGRAM=$PROGRAM
+        mv $WORK/output $WORK/expected
+        printf "  %-24s %6d ms\n" $PROGRAM $BEST
+    elif ! cmp -s $WORK/output $WORK/expected; then
+        echo "ERROR: $PROGRAM gives different output from $FIRST_PROGRAM"
+        STATUS=1
+    else
+        printf "  %-24s %6d ms  %d.%02dx\n" $PROGRAM $BEST \
+               $((FIRST_TIME / BEST)) $(((FIRST_TIME * 100 / BEST) % 100))
+    fi
+done
+
+exit $STATUS
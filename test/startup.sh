@@ -0,0 +1,80 @@
+#!/bin/bash
+#
+# This file is part of tcshParser.
+# Copyright (C) 2013 Ellexus (www.ellexus.com)
+#
+# tcshParser is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Time how long a number of builds of tcshParser take to expand a
+# single command, from exec to exit, check that they all give the same
+# output, and report how much faster each one is than the first:
+#
+#     ./startup.sh <alias-file> <program> <program> ...
+#
+# Each program expands COMMAND ("cdls /tmp" by default) COUNT times
+# (2000 by default), and is given the best of RUNS rounds (5 by
+# default). "make static" in the src directory uses this to compare
+# the static build with dynamic ones.
+
+ALIAS_FILE=$1
+shift
+
+COMMAND=${COMMAND:-cdls /tmp}
+COUNT=${COUNT:-2000}
+RUNS=${RUNS:-5}
+
+if [ -z "$ALIAS_FILE" ] || [ $# -eq 0 ]; then
+    echo "usage: $0 <alias-file> <program> ..."
+    exit 1
+fi
+
+WORK=`mktemp -d`
+trap "rm -rf $WORK" EXIT
+
+echo "$COUNT runs of \"$COMMAND\", time per run, best of $RUNS rounds:"
+
+STATUS=0
+FIRST_TIME=
+FIRST_PROGRAM=
+
+for PROGRAM in "$@"; do
+    BEST=
+    for ((i = 0; i < RUNS; i++)); do
+        START=`date +%s%N`
+        for ((j = 0; j < COUNT; j++)); do
+            $PROGRAM $ALIAS_FILE $COMMAND
+        done > $WORK/output
+        END=`date +%s%N`
+        TIME=$(((END - START) / 1000 / COUNT))
+        if [ -z "$BEST" ] || [ $TIME -lt $BEST ]; then
+            BEST=$TIME
+        fi
+    done
+    [ $BEST -gt 0 ] || BEST=1
+
+    if [ -z "$FIRST_TIME" ]; then
+        FIRST_TIME=$BEST
+        FIRST_PROGRAM=$PROGRAM
+        mv $WORK/output $WORK/expected
+        printf "  %-28s %6d us\n" $PROGRAM $BEST
+    elif ! cmp -s $WORK/output $WORK/expected; then
+        echo "ERROR: $PROGRAM gives different output from $FIRST_PROGRAM"
+        STATUS=1
+    else
+        printf "  %-28s %6d us  %d.%02dx\n" $PROGRAM $BEST \
+               $((FIRST_TIME / BEST)) $(((FIRST_TIME * 100 / BEST) % 100))
+    fi
+done
+
+exit $STATUS
@@ -20,9 +20,66 @@ SCRIPT_PATH=`readlink -f $0`
 TEST_PATH=`dirname $SCRIPT_PATH`
 
 PROGRAM=$TEST_PATH/../src/tcshParser
+LOCAL_PROGRAM=$PROGRAM
 
 ALIAS_FILE=$TEST_PATH/test-aliases.txt
 
+# A limit on the length of an expansion which check_limit's aliases
+# soon pass.
+
+LIMIT="-max-output 100K"
+
+# With "-builtin", build a tcshParser with the test aliases compiled
+# into it, and run all the checks using those.
+
+if [ "$1" = "-builtin" ]; then
+    make -s -C $TEST_PATH/../src tcshParser-site SITE_ALIASES=$ALIAS_FILE || exit 1
+
+    PROGRAM=$TEST_PATH/../src/tcshParser-site
+    LOCAL_PROGRAM=$PROGRAM
+    ALIAS_FILE=-builtin
+fi
+
+# With "-server", start a tcshParser server, and run all the checks
+# through it rather than running the program directly.
+
+if [ "$1" = "-server" ]; then
+    SOCKET=$(mktemp -u)
+    $PROGRAM $LIMIT -server $SOCKET -socket-mode 666 &
+    SERVER_PID=$!
+    trap "kill $SERVER_PID; rm -f $SOCKET" EXIT
+
+    while [ ! -S $SOCKET ]; do
+        sleep 0.1
+    done
+
+    PROGRAM="$PROGRAM -client $SOCKET"
+fi
+
+# With "-cache", run all the checks with an expansion cache, running
+# each one twice so that the second run finds it in the cache.
+
+if [ "$1" = "-cache" ]; then
+    CACHE_DIR=$(mktemp -d)
+    trap "rm -rf $CACHE_DIR" EXIT
+
+    PROGRAM="$PROGRAM -cache-dir $CACHE_DIR"
+fi
+
+# With "-memory", run all the checks within a fixed buffer, rather
+# than using malloc.
+
+if [ "$1" = "-memory" ]; then
+    PROGRAM="$PROGRAM -memory 1M"
+fi
+
+run_program () {
+    if [ -n "$CACHE_DIR" ]; then
+        $PROGRAM "$@" >/dev/null
+    fi
+    $PROGRAM "$@"
+}
+
 # Run the program with a specific command line, and compare the output
 # with what we expected, reporting either OK or ERROR.
 
@@ -32,7 +89,7 @@ check () {
     local L_RESULT=$(mktemp)
     local L_DIFF_FILE=$(mktemp)
 
-    $PROGRAM $ALIAS_FILE >$L_RESULT $L_INPUT 
+    run_program $ALIAS_FILE >$L_RESULT $L_INPUT 
 
     if echo $L_EXPECT | diff -b $L_RESULT - > $L_DIFF_FILE; then
         echo "OK: $L_INPUT"
@@ -53,6 +110,352 @@ check "commandandallbutlastarg alpha beta gamma" "echo commandandallbutlastarg a
 check "echospaces" "echo a b c"
 check "firstarg first second third" "echo first"
 check "firstthenlast first second third" "echo first ; echo third"
+# As check, but with each argument after the expected output passed to
+# the program as a single word, using -argv.
+
+check_argv () {
+    local L_EXPECT=$1
+    shift
+    local L_RESULT=$(run_program -argv $ALIAS_FILE "$@")
+
+    if [ "$(echo $L_RESULT)" = "$(echo $L_EXPECT)" ]; then
+        echo "OK: -argv $*"
+    else
+        echo "ERROR: -argv $*"
+        echo "< $L_RESULT"
+        echo "> $L_EXPECT"
+    fi
+}
+
+# As check, but using -0, and expecting each word of the output to be
+# followed by a NUL. The command is a single argument, and the rest
+# are the words we expect, so that they can contain spaces.
+
+check_nul () {
+    local L_INPUT=$1
+    local L_RESULT=$(run_program -0 $ALIAS_FILE "$L_INPUT" | tr '\0\n' '\n_')
+
+    shift
+    if [ "$L_RESULT" = "$(printf '%s\n' "$@")" ]; then
+        echo "OK: -0 $L_INPUT"
+    else
+        echo "ERROR: -0 $L_INPUT"
+        echo "< $L_RESULT"
+        echo "> $*"
+    fi
+}
+
+# Expand a very long command line of many simple commands, both in
+# one go and in parallel chunks, and check that the results are the
+# same.
+
+check_parallel () {
+    local L_COPIES=$1
+    local L_INPUT=$(for ((i = 0; i < L_COPIES; i++)); do
+                        echo -n "twice a$i b ; cdls /tmp/$i && a 1 2 3 | ls || "
+                    done; echo last)
+    local L_EXPECT=$(run_program -parallel 0 $ALIAS_FILE "$L_INPUT")
+    local L_RESULT=$(run_program -parallel 10 -threads 3 $ALIAS_FILE "$L_INPUT")
+
+    if [ -n "$L_EXPECT" ] && [ "$L_RESULT" = "$L_EXPECT" ]; then
+        echo "OK: -parallel with $L_COPIES copies"
+    else
+        echo "ERROR: -parallel with $L_COPIES copies"
+    fi
+}
+
+# Expand a whole script with -script, and compare the result with the
+# script given on the standard input.
+
+check_script () {
+    local L_NAME=$1
+    local L_SCRIPT=$(mktemp)
+    local L_RESULT=$(mktemp)
+    local L_DIFF_FILE=$(mktemp)
+
+    cat > $L_SCRIPT <<'END_SCRIPT'
+#!/bin/tcsh -f
+# cdls in a comment is left alone
+   cdls /tmp   # and so is this one
+set x = "a1"
+foreach f ( a1 twice )
+    twice $f b ; echo done
+end
+if ( -d /tmp ) then
+    cdls /tmp \
+        && a1
+endif
+echo `twice x y
+  a1` done
+echo "not # a comment" # a1
+label:
+echo one   ;  echo two
+END_SCRIPT
+
+    run_program -script $ALIAS_FILE $L_SCRIPT > $L_RESULT
+
+    if diff $L_RESULT - > $L_DIFF_FILE; then
+        echo "OK: -script $L_NAME"
+    else
+        echo "ERROR: -script $L_NAME"
+        cat $L_DIFF_FILE
+    fi
+
+    rm -f $L_SCRIPT $L_RESULT $L_DIFF_FILE
+}
+
+# Expand a script with a back-tick which is never closed, followed by
+# more than the longest line we expand, and check that it fails, but
+# still expands the rest of the script a line at a time.
+
+check_script_long_line () {
+    local L_SCRIPT=$(mktemp)
+    local L_RESULT=$(mktemp)
+    local L_STATUS
+
+    { echo 'echo `date'; seq 1 300000 | sed 's/^/ll /'; } > $L_SCRIPT
+
+    $LOCAL_PROGRAM -script $ALIAS_FILE $L_SCRIPT > $L_RESULT 2>/dev/null
+    L_STATUS=$?
+
+    if [ $L_STATUS -ne 0 ] && [ "$(sed -n '1p;$p' $L_RESULT)" = "echo \`date
+ls --color=tty -l --color=tty 300000" ]; then
+        echo "OK: -script long line"
+    else
+        echo "ERROR: -script long line"
+        sed -n '1,2p;$p' $L_RESULT
+    fi
+
+    rm -f $L_SCRIPT $L_RESULT
+}
+
+# Ask the server for its statistics, and check that it has counted
+# the requests made so far, and that every phase has been reported.
+
+check_server_stats () {
+    local L_STATS=$($TEST_PATH/../src/tcshParser -stats -client $SOCKET)
+    local L_PHASE
+
+    if ! echo "$L_STATS" | grep -q '^Binary requests: [1-9]'; then
+        echo "ERROR: -stats: no requests counted"
+        echo "$L_STATS"
+        return
+    fi
+
+    for L_PHASE in request table split history back-ticks post; do
+        if ! echo "$L_STATS" | grep -q "^$L_PHASE  *[0-9]"; then
+            echo "ERROR: -stats: no $L_PHASE phase"
+            echo "$L_STATS"
+            return
+        fi
+    done
+
+    echo "OK: -stats"
+}
+
+# Send the server a binary frame whose lengths add up to more than it
+# can hold, and check that it refuses it and is still there to answer
+# the next client.
+
+check_server_oversized_frame () {
+    local L_RESULT
+
+    L_RESULT=$(perl -MIO::Socket::UNIX -e '
+        my $s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or die "$ARGV[0]: $!\n";
+        print $s "\0TPB" . pack("NnnN", 1, 1, 1, 0xFFFFFFFF) . "x";
+        $s->flush();
+        read($s, my $header, 12) == 12 or exit(1);
+        my ($id, $flags, $path_length, $length) = unpack("NnnN", $header);
+        read($s, my $message, $length);
+        print "$flags $message\n";' $SOCKET)
+
+    if [ "$L_RESULT" != "1 Request too long" ]; then
+        echo "ERROR: oversized frame: $L_RESULT"
+    elif [ "$($PROGRAM $ALIAS_FILE ll x)" != "ls --color=tty -l --color=tty x" ]; then
+        echo "ERROR: oversized frame: server gone"
+    else
+        echo "OK: oversized frame"
+    fi
+}
+
+# Check that a client can only have the server use an alias file
+# which the client could read itself. Being another client needs
+# root.
+
+check_server_permissions () {
+    local L_DIR=$(mktemp -d)
+    local L_FILE
+    local L_RESULT
+    local L_EXPECTED="OK ls --color=tty -l --color=tty x
+ERR Unable to read alias file $L_DIR/private"
+
+    chmod 755 $L_DIR
+    cp $ALIAS_FILE $L_DIR/public
+    cp $ALIAS_FILE $L_DIR/private
+    chmod 644 $L_DIR/public
+    chmod 600 $L_DIR/private
+
+    L_RESULT=$(for L_FILE in public private; do
+        setpriv --reuid=65534 --regid=65534 --clear-groups perl -MIO::Socket::UNIX -e '
+            my $s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or die "$ARGV[0]: $!\n";
+            print $s "$ARGV[1]\tll x\n";
+            print scalar(<$s>);' $SOCKET $L_DIR/$L_FILE
+    done)
+
+    if [ "$L_RESULT" != "$L_EXPECTED" ]; then
+        echo "ERROR: permissions"
+        echo "$L_RESULT"
+    else
+        echo "OK: permissions"
+    fi
+
+    rm -rf $L_DIR
+}
+
+# Send the server rounds of line requests, megabytes in all, on one
+# connection, sending all of each round before reading any of the
+# responses, and check that every one is answered.
+
+check_server_pipeline () {
+    local L_ROUNDS=5
+    local L_COUNT=8000
+    local L_PADDING=$(printf 'x%.0s' {1..80})
+    local L_RESULT
+
+    L_RESULT=$(perl -MIO::Socket::UNIX -e '
+        my ($socket, $aliases, $rounds, $count, $padding) = @ARGV;
+        my $s = IO::Socket::UNIX->new(Peer => $socket) or die "$socket: $!\n";
+        my ($n, $last) = (0, "");
+        $SIG{ALRM} = sub { print "timed out after $n responses\n"; exit(1); };
+        alarm(60);
+        for my $round (1 .. $rounds) {
+            print $s "$aliases\tll $_ $padding\n" for 1 .. $count;
+            $s->flush();
+            for (1 .. $count) {
+                defined($last = <$s>) or last;
+                $n++;
+            }
+        }
+        print "$n $last";' $SOCKET $ALIAS_FILE $L_ROUNDS $L_COUNT $L_PADDING)
+
+    if [ "$L_RESULT" != "$((L_ROUNDS * L_COUNT)) OK ls --color=tty -l --color=tty $L_COUNT $L_PADDING" ]; then
+        echo "ERROR: pipeline: $L_RESULT"
+    else
+        echo "OK: pipeline"
+    fi
+}
+
+# Expand the training commands in batch mode, repeated on either side
+# of a command which is longer than a whole block, with one thread and
+# with several. Check that every command comes out in order, and the
+# same as when it is expanded on its own.
+
+check_batch () {
+    local L_COMMANDS=$TEST_PATH/training-commands.txt
+    local L_INPUT=$(mktemp)
+    local L_EXPECTED=$(mktemp)
+    local L_RESULT=$(mktemp)
+    local L_ONE=$(mktemp)
+    local L_LONG=$(printf 'w%d ' {1..300000})
+    local L_LINE
+    local L_THREADS
+    local L_STATUS="OK"
+
+    while IFS= read -r L_LINE; do
+        $LOCAL_PROGRAM $ALIAS_FILE "$L_LINE"
+    done < $L_COMMANDS > $L_ONE
+
+    for ((i = 0; i < 200; i++)); do cat $L_COMMANDS; done > $L_INPUT
+    echo "ll $L_LONG" >> $L_INPUT
+    for ((i = 0; i < 200; i++)); do cat $L_COMMANDS; done >> $L_INPUT
+
+    for ((i = 0; i < 200; i++)); do cat $L_ONE; done > $L_EXPECTED
+    echo "ls --color=tty -l --color=tty $L_LONG" >> $L_EXPECTED
+    for ((i = 0; i < 200; i++)); do cat $L_ONE; done >> $L_EXPECTED
+
+    for L_THREADS in 1 4; do
+        $LOCAL_PROGRAM -batch -threads $L_THREADS $ALIAS_FILE < $L_INPUT > $L_RESULT
+        if ! diff -b -q $L_EXPECTED $L_RESULT > /dev/null; then
+            echo "ERROR: -batch -threads $L_THREADS"
+            diff -b $L_EXPECTED $L_RESULT | head -5 | cut -c1-200
+            L_STATUS="ERROR"
+        fi
+    done
+
+    if [ $L_STATUS = "OK" ]; then
+        echo "OK: -batch"
+    fi
+
+    rm -f $L_INPUT $L_EXPECTED $L_RESULT $L_ONE
+}
+
+# Expand a command whose expansion passes the limit, using aliases
+# "ping" and "pong" which double their arguments to each other, on its
+# own and in a batch, and check that it fails without stopping the
+# batch.
+
+check_limit () {
+    local L_ALIASES=$(mktemp)
+    local L_RESULT
+    local L_STATUS
+
+    printf 'ping\tpong !* !*\npong\tping !* !*\na1\tdu -l\n' > $L_ALIASES
+
+    L_RESULT=$(run_program $LIMIT $L_ALIASES ping x 2>/dev/null)
+    L_STATUS=$?
+    if [ $L_STATUS -eq 0 ] || [ -n "$L_RESULT" ]; then
+        echo "ERROR: $LIMIT ping x"
+    else
+        L_RESULT=$(printf 'ping x\na1\n' | $LOCAL_PROGRAM -batch $LIMIT $L_ALIASES 2>/dev/null)
+        L_STATUS=$?
+        if [ $L_STATUS -eq 0 ] || [ "$L_RESULT" != "$(printf '\ndu -l')" ]; then
+            echo "ERROR: -batch $LIMIT"
+            echo "$L_RESULT"
+        else
+            echo "OK: $LIMIT"
+        fi
+    fi
+
+    rm -f $L_ALIASES
+}
+
+# Count the expanded commands, or their names, with -aggregate, and
+# compare the report with the one expected on the standard input.
+
+check_aggregate () {
+    local L_OPTIONS=$1
+    local L_RESULT=$(for ((i = 0; i < 3; i++)); do
+                         echo "twice a b"; echo "cdls /tmp"; echo "twice a b"; echo "a1"
+                     done | $LOCAL_PROGRAM -aggregate $L_OPTIONS $ALIAS_FILE)
+
+    if [ "$L_RESULT" = "$(cat)" ]; then
+        echo "OK: -aggregate $L_OPTIONS"
+    else
+        echo "ERROR: -aggregate $L_OPTIONS"
+        echo "$L_RESULT"
+    fi
+}
+
+# Count a command whose expansion is longer than the buffer it is read
+# back into, along with empty lines, which shouldn't be counted, and
+# check that the long command is counted once, as itself.
+
+check_aggregate_lines () {
+    local L_LONG=$(printf 'w%d ' {1..300000})
+    local L_RESULT=$(printf 'll x\nll %s\n\nll x\n\n' "$L_LONG" |
+                         $LOCAL_PROGRAM -aggregate $ALIAS_FILE | cut -c1-60)
+    local L_EXPECTED="# 3 counted, 2 distinct
+         2  ls --color=tty -l --color=tty x
+         1  ls --color=tty -l --color=tty w1 w2 w3 w4 w5 w6 "
+
+    if [ "$L_RESULT" = "$L_EXPECTED" ]; then
+        echo "OK: -aggregate lines"
+    else
+        echo "ERROR: -aggregate lines"
+        echo "$L_RESULT"
+    fi
+}
+
 check "echoeverything one two three" "echo echoeverything one two three"
 check "secondandthird one two three four" "echo two three"
 check "secondarg one two three four" "echo two"
@@ -77,3 +480,66 @@ check "begintoendalt 1 2 3" "echo 1 2 3"
 check "a 1 2 3 4 5 6" "echo this is b 1 && echo this is c 2"
 check "a \"1 2 3\" \"4 5 6\"" "echo this is b 1 2 3 && echo this is c 4 5 6"
 check "two 1 \"2 3 4\"" "echo 2 3 4"
+
+# These two names have the same hash, which the perfect hash built
+# for -builtin must still tell apart.
+
+check "costarring x" "echo costarring x"
+check "liquid x" "echo liquid x"
+check_argv "echo this is b 1 2 3 && echo this is c 4 5 6" a "1 2 3" "4 5 6"
+check_argv "echo 2 3 4" two 1 "2 3 4"
+check_argv "echo one two &&ls --color=tty" allargs one two "&&" ls
+check_argv "echo this is b && echo this is c" a "" ""
+check_nul "a 1 2 3 4 5 6" echo this is b 1 "&&" echo this is c 2
+check_nul "cdls /tmp" cd /tmp "&&" ls --color=tty
+check_nul 'echo "a b" "" c\ d' echo "a b" "" 'c\ d'
+check_nul 'echo "x `y` z" `ll "a b"`' echo "x \`y\` z" '`ls --color=tty -l --color=tty a b`'
+check_parallel 250
+check_parallel 3
+check_limit
+check_script "with continuations and comments" <<'END_SCRIPT'
+#!/bin/tcsh -f
+# cdls in a comment is left alone
+   cd /tmp  && ls --color=tty   # and so is this one
+set x = "a1"
+foreach f ( a1 twice )
+    echo $f $f ;echo done
+end
+if ( -d /tmp ) then
+    cd /tmp  && ls --color=tty &&du -l
+endif
+echo `echo x x;du -l` done
+echo "not # a comment" # a1
+label:
+echo one   ;  echo two
+END_SCRIPT
+check_script_long_line
+check_aggregate "-top 2" <<'END_REPORT'
+# 12 counted, 3 distinct
+         6  echo a a
+         3  cd /tmp  && ls --color=tty
+END_REPORT
+check_aggregate "-names" <<'END_REPORT'
+# 15 counted, 4 distinct
+         6  echo
+         3  cd
+         3  du
+         3  ls
+END_REPORT
+check_aggregate "-max-distinct 1" <<'END_REPORT'
+# 12 counted, more than 1 distinct: counts are upper bounds, less at most the second column
+        12         11  du -l
+END_REPORT
+check_aggregate_lines
+
+check_batch
+
+if [ -n "$SOCKET" ]; then
+    check_server_stats
+    check_server_pipeline
+    check_server_oversized_frame
+
+    if [ "$(id -u)" = 0 ] && which setpriv > /dev/null; then
+        check_server_permissions
+    fi
+fi